@@ -0,0 +1,455 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "InMemoryOnlineSession.h"
+#include "OnlineSubsystemTypes.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogInMemoryOnlineSession, Log, All);
+
+static const TCHAR* InMemoryIdType = TEXT("InMemory");
+
+// Every session lives on this host, joins connect back to it
+static const TCHAR* InMemoryConnectString = TEXT("127.0.0.1:7777");
+
+FInMemoryOnlineSessionInfo::FInMemoryOnlineSessionInfo(const FString& sessionId) :
+  SessionId(FUniqueNetIdString::Create(sessionId, InMemoryIdType))
+{
+}
+
+void FInMemoryOnlineSession::Flush()
+{
+  // completions may issue the next operation, e.g. a create after a destroy
+  while (PendingCompletions.Num() > 0)
+  {
+    TArray<TUniqueFunction<void()>> completions = MoveTemp(PendingCompletions);
+    PendingCompletions.Reset();
+    for (TUniqueFunction<void()>& completion : completions)
+    {
+      completion();
+    }
+  }
+}
+
+SIZE_T FInMemoryOnlineSession::GetAllocatedSize() const
+{
+  return Sessions.GetAllocatedSize() + Sessions.Num() * sizeof(FNamedOnlineSession) + PendingCompletions.GetAllocatedSize();
+}
+
+FDelegateHandle FInMemoryOnlineSession::AddOnCreateSessionCompleteDelegate_Handle(const FOnCreateSessionCompleteDelegate& Delegate)
+{
+  ++NumBoundDelegates;
+  return IOnlineSession::AddOnCreateSessionCompleteDelegate_Handle(Delegate);
+}
+
+void FInMemoryOnlineSession::ClearOnCreateSessionCompleteDelegate_Handle(FDelegateHandle& Handle)
+{
+  NumBoundDelegates -= Handle.IsValid() ? 1 : 0;
+  IOnlineSession::ClearOnCreateSessionCompleteDelegate_Handle(Handle);
+}
+
+FDelegateHandle FInMemoryOnlineSession::AddOnFindSessionsCompleteDelegate_Handle(const FOnFindSessionsCompleteDelegate& Delegate)
+{
+  ++NumBoundDelegates;
+  return IOnlineSession::AddOnFindSessionsCompleteDelegate_Handle(Delegate);
+}
+
+void FInMemoryOnlineSession::ClearOnFindSessionsCompleteDelegate_Handle(FDelegateHandle& Handle)
+{
+  NumBoundDelegates -= Handle.IsValid() ? 1 : 0;
+  IOnlineSession::ClearOnFindSessionsCompleteDelegate_Handle(Handle);
+}
+
+FDelegateHandle FInMemoryOnlineSession::AddOnJoinSessionCompleteDelegate_Handle(const FOnJoinSessionCompleteDelegate& Delegate)
+{
+  ++NumBoundDelegates;
+  return IOnlineSession::AddOnJoinSessionCompleteDelegate_Handle(Delegate);
+}
+
+void FInMemoryOnlineSession::ClearOnJoinSessionCompleteDelegate_Handle(FDelegateHandle& Handle)
+{
+  NumBoundDelegates -= Handle.IsValid() ? 1 : 0;
+  IOnlineSession::ClearOnJoinSessionCompleteDelegate_Handle(Handle);
+}
+
+FDelegateHandle FInMemoryOnlineSession::AddOnDestroySessionCompleteDelegate_Handle(const FOnDestroySessionCompleteDelegate& Delegate)
+{
+  ++NumBoundDelegates;
+  return IOnlineSession::AddOnDestroySessionCompleteDelegate_Handle(Delegate);
+}
+
+void FInMemoryOnlineSession::ClearOnDestroySessionCompleteDelegate_Handle(FDelegateHandle& Handle)
+{
+  NumBoundDelegates -= Handle.IsValid() ? 1 : 0;
+  IOnlineSession::ClearOnDestroySessionCompleteDelegate_Handle(Handle);
+}
+
+FDelegateHandle FInMemoryOnlineSession::AddOnStartSessionCompleteDelegate_Handle(const FOnStartSessionCompleteDelegate& Delegate)
+{
+  ++NumBoundDelegates;
+  return IOnlineSession::AddOnStartSessionCompleteDelegate_Handle(Delegate);
+}
+
+void FInMemoryOnlineSession::ClearOnStartSessionCompleteDelegate_Handle(FDelegateHandle& Handle)
+{
+  NumBoundDelegates -= Handle.IsValid() ? 1 : 0;
+  IOnlineSession::ClearOnStartSessionCompleteDelegate_Handle(Handle);
+}
+
+FUniqueNetIdPtr FInMemoryOnlineSession::CreateSessionIdFromString(const FString& SessionIdStr)
+{
+  return FUniqueNetIdString::Create(SessionIdStr, InMemoryIdType);
+}
+
+FNamedOnlineSession* FInMemoryOnlineSession::FindSession(FName sessionName)
+{
+  for (const TUniquePtr<FNamedOnlineSession>& session : Sessions)
+  {
+    if (session->SessionName == sessionName) return session.Get();
+  }
+  return nullptr;
+}
+
+FNamedOnlineSession* FInMemoryOnlineSession::GetNamedSession(FName SessionName)
+{
+  return FindSession(SessionName);
+}
+
+void FInMemoryOnlineSession::RemoveNamedSession(FName SessionName)
+{
+  Sessions.RemoveAll([SessionName](const TUniquePtr<FNamedOnlineSession>& session) { return session->SessionName == SessionName; });
+}
+
+EOnlineSessionState::Type FInMemoryOnlineSession::GetSessionState(FName SessionName) const
+{
+  for (const TUniquePtr<FNamedOnlineSession>& session : Sessions)
+  {
+    if (session->SessionName == SessionName) return session->SessionState;
+  }
+  return EOnlineSessionState::NoSession;
+}
+
+bool FInMemoryOnlineSession::HasPresenceSession()
+{
+  return Sessions.ContainsByPredicate([](const TUniquePtr<FNamedOnlineSession>& session) { return session->SessionSettings.bUsesPresence; });
+}
+
+FNamedOnlineSession* FInMemoryOnlineSession::AddNamedSession(FName SessionName, const FOnlineSessionSettings& SessionSettings)
+{
+  return Sessions.Add_GetRef(MakeUnique<FNamedOnlineSession>(SessionName, SessionSettings)).Get();
+}
+
+FNamedOnlineSession* FInMemoryOnlineSession::AddNamedSession(FName SessionName, const FOnlineSession& Session)
+{
+  return Sessions.Add_GetRef(MakeUnique<FNamedOnlineSession>(SessionName, Session)).Get();
+}
+
+bool FInMemoryOnlineSession::CreateSession(int32 HostingPlayerNum, FName SessionName, const FOnlineSessionSettings& NewSessionSettings)
+{
+  return CreateSession(*FUniqueNetIdString::Create(FString::FromInt(HostingPlayerNum), InMemoryIdType), SessionName, NewSessionSettings);
+}
+
+bool FInMemoryOnlineSession::CreateSession(const FUniqueNetId& HostingPlayerId, FName SessionName, const FOnlineSessionSettings& NewSessionSettings)
+{
+  if (FindSession(SessionName)) return false;
+
+  FNamedOnlineSession* session = AddNamedSession(SessionName, NewSessionSettings);
+  session->SessionInfo = MakeShared<FInMemoryOnlineSessionInfo>(FString::Printf(TEXT("InMemorySession%d"), NextSessionId++));
+  session->SessionState = EOnlineSessionState::Pending;
+  session->OwningUserId = HostingPlayerId.AsShared();
+  session->LocalOwnerId = HostingPlayerId.AsShared();
+  session->OwningUserName = HostingPlayerId.ToString();
+  session->bHosting = true;
+  session->NumOpenPublicConnections = NewSessionSettings.NumPublicConnections;
+
+  PendingCompletions.Add([this, SessionName]() { TriggerOnCreateSessionCompleteDelegates(SessionName, true); });
+  return true;
+}
+
+bool FInMemoryOnlineSession::StartSession(FName SessionName)
+{
+  FNamedOnlineSession* session = FindSession(SessionName);
+  if (session)
+  {
+    session->SessionState = EOnlineSessionState::InProgress;
+  }
+
+  PendingCompletions.Add([this, SessionName, bFound = session != nullptr]() { TriggerOnStartSessionCompleteDelegates(SessionName, bFound); });
+  return true;
+}
+
+bool FInMemoryOnlineSession::UpdateSession(FName SessionName, FOnlineSessionSettings& UpdatedSessionSettings, bool bShouldRefreshOnlineData)
+{
+  FNamedOnlineSession* session = FindSession(SessionName);
+  if (session)
+  {
+    session->SessionSettings = UpdatedSessionSettings;
+  }
+
+  PendingCompletions.Add([this, SessionName, bFound = session != nullptr]() { TriggerOnUpdateSessionCompleteDelegates(SessionName, bFound); });
+  return true;
+}
+
+bool FInMemoryOnlineSession::EndSession(FName SessionName)
+{
+  FNamedOnlineSession* session = FindSession(SessionName);
+  if (session)
+  {
+    session->SessionState = EOnlineSessionState::Ended;
+  }
+
+  PendingCompletions.Add([this, SessionName, bFound = session != nullptr]() { TriggerOnEndSessionCompleteDelegates(SessionName, bFound); });
+  return true;
+}
+
+bool FInMemoryOnlineSession::DestroySession(FName SessionName, const FOnDestroySessionCompleteDelegate& CompletionDelegate)
+{
+  const bool bFound = FindSession(SessionName) != nullptr;
+  RemoveNamedSession(SessionName);
+
+  PendingCompletions.Add([this, SessionName, bFound, CompletionDelegate]()
+    {
+      CompletionDelegate.ExecuteIfBound(SessionName, bFound);
+      TriggerOnDestroySessionCompleteDelegates(SessionName, bFound);
+    });
+  return true;
+}
+
+bool FInMemoryOnlineSession::IsPlayerInSession(FName SessionName, const FUniqueNetId& UniqueId)
+{
+  const FNamedOnlineSession* session = FindSession(SessionName);
+  return session && session->RegisteredPlayers.ContainsByPredicate([&UniqueId](const FUniqueNetIdRef& player) { return *player == UniqueId; });
+}
+
+bool FInMemoryOnlineSession::StartMatchmaking(const TArray<FUniqueNetIdRef>& LocalPlayers, FName SessionName, const FOnlineSessionSettings& NewSessionSettings, TSharedRef<FOnlineSessionSearch>& SearchSettings)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::CancelMatchmaking(int32 SearchingPlayerNum, FName SessionName)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::CancelMatchmaking(const FUniqueNetId& SearchingPlayerId, FName SessionName)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::FindSessions(int32 SearchingPlayerNum, const TSharedRef<FOnlineSessionSearch>& SearchSettings)
+{
+  return FindSessions(*FUniqueNetIdString::Create(FString::FromInt(SearchingPlayerNum), InMemoryIdType), SearchSettings);
+}
+
+bool FInMemoryOnlineSession::FindSessions(const FUniqueNetId& SearchingPlayerId, const TSharedRef<FOnlineSessionSearch>& SearchSettings)
+{
+  SearchSettings->SearchState = EOnlineAsyncTaskState::InProgress;
+
+  PendingCompletions.Add([this, SearchSettings]()
+    {
+      // the sessions as they are when the search completes, like a backend answering later
+      SearchSettings->SearchResults.Reset();
+      for (const TUniquePtr<FNamedOnlineSession>& session : Sessions)
+      {
+        if (!session->bHosting || !session->SessionSettings.bShouldAdvertise) continue;
+        if (SearchSettings->SearchResults.Num() >= SearchSettings->MaxSearchResults) break;
+
+        FOnlineSessionSearchResult& result = SearchSettings->SearchResults.AddDefaulted_GetRef();
+        result.Session = *session;
+        result.PingInMs = 0;
+      }
+      SearchSettings->SearchState = EOnlineAsyncTaskState::Done;
+      TriggerOnFindSessionsCompleteDelegates(true);
+    });
+  return true;
+}
+
+bool FInMemoryOnlineSession::FindSessionById(const FUniqueNetId& SearchingUserId, const FUniqueNetId& SessionId, const FUniqueNetId& FriendId, const FOnSingleSessionResultCompleteDelegate& CompletionDelegate)
+{
+  FOnlineSessionSearchResult result;
+  bool bFound = false;
+  for (const TUniquePtr<FNamedOnlineSession>& session : Sessions)
+  {
+    if (session->bHosting && session->SessionInfo.IsValid() && session->SessionInfo->GetSessionId() == SessionId)
+    {
+      result.Session = *session;
+      bFound = true;
+      break;
+    }
+  }
+
+  PendingCompletions.Add([CompletionDelegate, bFound, result]() { CompletionDelegate.ExecuteIfBound(0, bFound, result); });
+  return true;
+}
+
+bool FInMemoryOnlineSession::CancelFindSessions()
+{
+  PendingCompletions.Add([this]() { TriggerOnCancelFindSessionsCompleteDelegates(true); });
+  return true;
+}
+
+bool FInMemoryOnlineSession::PingSearchResults(const FOnlineSessionSearchResult& SearchResult)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::JoinSession(int32 PlayerNum, FName SessionName, const FOnlineSessionSearchResult& DesiredSession)
+{
+  return JoinSession(*FUniqueNetIdString::Create(FString::FromInt(PlayerNum), InMemoryIdType), SessionName, DesiredSession);
+}
+
+bool FInMemoryOnlineSession::JoinSession(const FUniqueNetId& PlayerId, FName SessionName, const FOnlineSessionSearchResult& DesiredSession)
+{
+  EOnJoinSessionCompleteResult::Type result = EOnJoinSessionCompleteResult::Success;
+  if (FindSession(SessionName))
+  {
+    result = EOnJoinSessionCompleteResult::AlreadyInSession;
+  }
+  else if (!DesiredSession.IsValid())
+  {
+    result = EOnJoinSessionCompleteResult::SessionDoesNotExist;
+  }
+  else
+  {
+    FNamedOnlineSession* session = AddNamedSession(SessionName, DesiredSession.Session);
+    session->SessionState = EOnlineSessionState::Pending;
+    session->LocalOwnerId = PlayerId.AsShared();
+    session->bHosting = false;
+  }
+
+  PendingCompletions.Add([this, SessionName, result]() { TriggerOnJoinSessionCompleteDelegates(SessionName, result); });
+  return true;
+}
+
+bool FInMemoryOnlineSession::FindFriendSession(int32 LocalUserNum, const FUniqueNetId& Friend)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::FindFriendSession(const FUniqueNetId& LocalUserId, const FUniqueNetId& Friend)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::FindFriendSession(const FUniqueNetId& LocalUserId, const TArray<FUniqueNetIdRef>& FriendList)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::SendSessionInviteToFriend(int32 LocalUserNum, FName SessionName, const FUniqueNetId& Friend)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::SendSessionInviteToFriend(const FUniqueNetId& LocalUserId, FName SessionName, const FUniqueNetId& Friend)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::SendSessionInviteToFriends(int32 LocalUserNum, FName SessionName, const TArray<FUniqueNetIdRef>& Friends)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::SendSessionInviteToFriends(const FUniqueNetId& LocalUserId, FName SessionName, const TArray<FUniqueNetIdRef>& Friends)
+{
+  return false;
+}
+
+bool FInMemoryOnlineSession::GetResolvedConnectString(FName SessionName, FString& ConnectInfo, FName PortType)
+{
+  if (!FindSession(SessionName)) return false;
+
+  ConnectInfo = InMemoryConnectString;
+  return true;
+}
+
+bool FInMemoryOnlineSession::GetResolvedConnectString(const FOnlineSessionSearchResult& SearchResult, FName PortType, FString& ConnectInfo)
+{
+  if (!SearchResult.IsValid()) return false;
+
+  ConnectInfo = InMemoryConnectString;
+  return true;
+}
+
+FOnlineSessionSettings* FInMemoryOnlineSession::GetSessionSettings(FName SessionName)
+{
+  FNamedOnlineSession* session = FindSession(SessionName);
+  return session ? &session->SessionSettings : nullptr;
+}
+
+bool FInMemoryOnlineSession::RegisterPlayer(FName SessionName, const FUniqueNetId& PlayerId, bool bWasInvited)
+{
+  TArray<FUniqueNetIdRef> players;
+  players.Add(PlayerId.AsShared());
+  return RegisterPlayers(SessionName, players, bWasInvited);
+}
+
+bool FInMemoryOnlineSession::RegisterPlayers(FName SessionName, const TArray<FUniqueNetIdRef>& Players, bool bWasInvited)
+{
+  FNamedOnlineSession* session = FindSession(SessionName);
+  if (session)
+  {
+    for (const FUniqueNetIdRef& player : Players)
+    {
+      if (!session->RegisteredPlayers.ContainsByPredicate([&player](const FUniqueNetIdRef& registered) { return *registered == *player; }))
+      {
+        session->RegisteredPlayers.Add(player);
+      }
+    }
+  }
+
+  TriggerOnRegisterPlayersCompleteDelegates(SessionName, Players, session != nullptr);
+  return session != nullptr;
+}
+
+bool FInMemoryOnlineSession::UnregisterPlayer(FName SessionName, const FUniqueNetId& PlayerId)
+{
+  TArray<FUniqueNetIdRef> players;
+  players.Add(PlayerId.AsShared());
+  return UnregisterPlayers(SessionName, players);
+}
+
+bool FInMemoryOnlineSession::UnregisterPlayers(FName SessionName, const TArray<FUniqueNetIdRef>& Players)
+{
+  FNamedOnlineSession* session = FindSession(SessionName);
+  if (session)
+  {
+    for (const FUniqueNetIdRef& player : Players)
+    {
+      session->RegisteredPlayers.RemoveAll([&player](const FUniqueNetIdRef& registered) { return *registered == *player; });
+    }
+  }
+
+  TriggerOnUnregisterPlayersCompleteDelegates(SessionName, Players, session != nullptr);
+  return session != nullptr;
+}
+
+void FInMemoryOnlineSession::RegisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnRegisterLocalPlayerCompleteDelegate& Delegate)
+{
+  Delegate.ExecuteIfBound(PlayerId, EOnJoinSessionCompleteResult::Success);
+}
+
+void FInMemoryOnlineSession::UnregisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnUnregisterLocalPlayerCompleteDelegate& Delegate)
+{
+  Delegate.ExecuteIfBound(PlayerId, true);
+}
+
+void FInMemoryOnlineSession::RemovePlayerFromSession(int32 LocalUserNum, FName SessionName, const FUniqueNetId& TargetPlayerId)
+{
+  UnregisterPlayer(SessionName, TargetPlayerId);
+}
+
+int32 FInMemoryOnlineSession::GetNumSessions()
+{
+  return Sessions.Num();
+}
+
+void FInMemoryOnlineSession::DumpSessionState()
+{
+  for (const TUniquePtr<FNamedOnlineSession>& session : Sessions)
+  {
+    UE_LOG(LogInMemoryOnlineSession, Display, TEXT("%s: %s, %s, %d registered players"),
+      *session->SessionName.ToString(), EOnlineSessionState::ToString(session->SessionState),
+      session->bHosting ? TEXT("hosting") : TEXT("joined"), session->RegisteredPlayers.Num());
+  }
+}
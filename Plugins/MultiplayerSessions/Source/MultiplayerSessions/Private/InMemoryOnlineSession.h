@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/OnlineSessionInterface.h"
+#include "OnlineSessionSettings.h"
+
+/**
+ * Session info of a session of FInMemoryOnlineSession, connects to the local host
+ */
+class FInMemoryOnlineSessionInfo : public FOnlineSessionInfo
+{
+public:
+  explicit FInMemoryOnlineSessionInfo(const FString& sessionId);
+
+  virtual const uint8* GetBytes() const override { return nullptr; }
+  virtual int32 GetSize() const override { return sizeof(FInMemoryOnlineSessionInfo); }
+  virtual bool IsValid() const override { return true; }
+  virtual const FUniqueNetId& GetSessionId() const override { return *SessionId; }
+  virtual FString ToString() const override { return SessionId->ToString(); }
+  virtual FString ToDebugString() const override { return FString::Printf(TEXT("InMemory session %s"), *SessionId->ToString()); }
+
+private:
+  FUniqueNetIdRef SessionId;
+};
+
+/**
+ * Session interface that keeps all sessions of this process in memory, for the soak test.
+ *
+ * Completion delegates fire when Flush is called rather than from inside the call, like the callbacks of a real
+ * backend arrive on a later frame. Sessions are found by the process that created them, which joins them under
+ * another session name.
+ */
+class FInMemoryOnlineSession : public IOnlineSession
+{
+public:
+  // Runs the completion delegates of the operations issued so far
+  void Flush();
+
+  // Completion delegates currently bound to the interface
+  int32 GetNumBoundDelegates() const { return NumBoundDelegates; }
+  SIZE_T GetAllocatedSize() const;
+
+  // Delegate registration is counted so leaked bindings show up in the soak test
+  virtual FDelegateHandle AddOnCreateSessionCompleteDelegate_Handle(const FOnCreateSessionCompleteDelegate& Delegate) override;
+  virtual void ClearOnCreateSessionCompleteDelegate_Handle(FDelegateHandle& Handle) override;
+  virtual FDelegateHandle AddOnFindSessionsCompleteDelegate_Handle(const FOnFindSessionsCompleteDelegate& Delegate) override;
+  virtual void ClearOnFindSessionsCompleteDelegate_Handle(FDelegateHandle& Handle) override;
+  virtual FDelegateHandle AddOnJoinSessionCompleteDelegate_Handle(const FOnJoinSessionCompleteDelegate& Delegate) override;
+  virtual void ClearOnJoinSessionCompleteDelegate_Handle(FDelegateHandle& Handle) override;
+  virtual FDelegateHandle AddOnDestroySessionCompleteDelegate_Handle(const FOnDestroySessionCompleteDelegate& Delegate) override;
+  virtual void ClearOnDestroySessionCompleteDelegate_Handle(FDelegateHandle& Handle) override;
+  virtual FDelegateHandle AddOnStartSessionCompleteDelegate_Handle(const FOnStartSessionCompleteDelegate& Delegate) override;
+  virtual void ClearOnStartSessionCompleteDelegate_Handle(FDelegateHandle& Handle) override;
+
+  // IOnlineSession
+  virtual FUniqueNetIdPtr CreateSessionIdFromString(const FString& SessionIdStr) override;
+  virtual FNamedOnlineSession* GetNamedSession(FName SessionName) override;
+  virtual void RemoveNamedSession(FName SessionName) override;
+  virtual EOnlineSessionState::Type GetSessionState(FName SessionName) const override;
+  virtual bool HasPresenceSession() override;
+  virtual bool CreateSession(int32 HostingPlayerNum, FName SessionName, const FOnlineSessionSettings& NewSessionSettings) override;
+  virtual bool CreateSession(const FUniqueNetId& HostingPlayerId, FName SessionName, const FOnlineSessionSettings& NewSessionSettings) override;
+  virtual bool StartSession(FName SessionName) override;
+  virtual bool UpdateSession(FName SessionName, FOnlineSessionSettings& UpdatedSessionSettings, bool bShouldRefreshOnlineData = true) override;
+  virtual bool EndSession(FName SessionName) override;
+  virtual bool DestroySession(FName SessionName, const FOnDestroySessionCompleteDelegate& CompletionDelegate = FOnDestroySessionCompleteDelegate()) override;
+  virtual bool IsPlayerInSession(FName SessionName, const FUniqueNetId& UniqueId) override;
+  virtual bool StartMatchmaking(const TArray<FUniqueNetIdRef>& LocalPlayers, FName SessionName, const FOnlineSessionSettings& NewSessionSettings, TSharedRef<FOnlineSessionSearch>& SearchSettings) override;
+  virtual bool CancelMatchmaking(int32 SearchingPlayerNum, FName SessionName) override;
+  virtual bool CancelMatchmaking(const FUniqueNetId& SearchingPlayerId, FName SessionName) override;
+  virtual bool FindSessions(int32 SearchingPlayerNum, const TSharedRef<FOnlineSessionSearch>& SearchSettings) override;
+  virtual bool FindSessions(const FUniqueNetId& SearchingPlayerId, const TSharedRef<FOnlineSessionSearch>& SearchSettings) override;
+  virtual bool FindSessionById(const FUniqueNetId& SearchingUserId, const FUniqueNetId& SessionId, const FUniqueNetId& FriendId, const FOnSingleSessionResultCompleteDelegate& CompletionDelegate) override;
+  virtual bool CancelFindSessions() override;
+  virtual bool PingSearchResults(const FOnlineSessionSearchResult& SearchResult) override;
+  virtual bool JoinSession(int32 PlayerNum, FName SessionName, const FOnlineSessionSearchResult& DesiredSession) override;
+  virtual bool JoinSession(const FUniqueNetId& PlayerId, FName SessionName, const FOnlineSessionSearchResult& DesiredSession) override;
+  virtual bool FindFriendSession(int32 LocalUserNum, const FUniqueNetId& Friend) override;
+  virtual bool FindFriendSession(const FUniqueNetId& LocalUserId, const FUniqueNetId& Friend) override;
+  virtual bool FindFriendSession(const FUniqueNetId& LocalUserId, const TArray<FUniqueNetIdRef>& FriendList) override;
+  virtual bool SendSessionInviteToFriend(int32 LocalUserNum, FName SessionName, const FUniqueNetId& Friend) override;
+  virtual bool SendSessionInviteToFriend(const FUniqueNetId& LocalUserId, FName SessionName, const FUniqueNetId& Friend) override;
+  virtual bool SendSessionInviteToFriends(int32 LocalUserNum, FName SessionName, const TArray<FUniqueNetIdRef>& Friends) override;
+  virtual bool SendSessionInviteToFriends(const FUniqueNetId& LocalUserId, FName SessionName, const TArray<FUniqueNetIdRef>& Friends) override;
+  virtual bool GetResolvedConnectString(FName SessionName, FString& ConnectInfo, FName PortType = NAME_GamePort) override;
+  virtual bool GetResolvedConnectString(const FOnlineSessionSearchResult& SearchResult, FName PortType, FString& ConnectInfo) override;
+  virtual FOnlineSessionSettings* GetSessionSettings(FName SessionName) override;
+  virtual bool RegisterPlayer(FName SessionName, const FUniqueNetId& PlayerId, bool bWasInvited) override;
+  virtual bool RegisterPlayers(FName SessionName, const TArray<FUniqueNetIdRef>& Players, bool bWasInvited = false) override;
+  virtual bool UnregisterPlayer(FName SessionName, const FUniqueNetId& PlayerId) override;
+  virtual bool UnregisterPlayers(FName SessionName, const TArray<FUniqueNetIdRef>& Players) override;
+  virtual void RegisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnRegisterLocalPlayerCompleteDelegate& Delegate) override;
+  virtual void UnregisterLocalPlayer(const FUniqueNetId& PlayerId, FName SessionName, const FOnUnregisterLocalPlayerCompleteDelegate& Delegate) override;
+  virtual void RemovePlayerFromSession(int32 LocalUserNum, FName SessionName, const FUniqueNetId& TargetPlayerId) override;
+  virtual int32 GetNumSessions() override;
+  virtual void DumpSessionState() override;
+
+protected:
+  virtual FNamedOnlineSession* AddNamedSession(FName SessionName, const FOnlineSessionSettings& SessionSettings) override;
+  virtual FNamedOnlineSession* AddNamedSession(FName SessionName, const FOnlineSession& Session) override;
+
+private:
+  FNamedOnlineSession* FindSession(FName sessionName);
+
+private:
+  // Named sessions are handed out by pointer, so they are allocated one by one
+  TArray<TUniquePtr<FNamedOnlineSession>> Sessions;
+  TArray<TUniqueFunction<void()>> PendingCompletions;
+  int32 NextSessionId = 1;
+  int32 NumBoundDelegates = 0;
+};
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MatchmakerCommandlet.h"
+#include "MultiplayerMatchmakerService.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Containers/Ticker.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/CoreDelegates.h"
+
+UMatchmakerCommandlet::UMatchmakerCommandlet()
+{
+  IsClient = false;
+  IsServer = false;
+  IsEditor = false;
+  LogToConsole = true;
+}
+
+int32 UMatchmakerCommandlet::Main(const FString& Params)
+{
+  uint32 port = FMultiplayerMatchmakerService::DefaultPort;
+  FParse::Value(*Params, TEXT("Port="), port);
+
+  FMultiplayerMatchmakerService service;
+  if (!service.Start(port)) return 1;
+
+  // the HTTP listeners and the session expiry run on the core ticker
+  double lastTime = FPlatformTime::Seconds();
+  while (!IsEngineExitRequested())
+  {
+    const double now = FPlatformTime::Seconds();
+    FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+    FTSTicker::GetCoreTicker().Tick(static_cast<float>(now - lastTime));
+    lastTime = now;
+
+    FPlatformProcess::Sleep(0.001f);
+  }
+
+  service.Stop();
+  return 0;
+}
@@ -5,8 +5,8 @@
 #include "MultiplayerSessions_HelperFunctions.h"
 #include "Components/Button.h"
 #include "MultiplayerSessionsSubsystem.h"
+#include "MultiplayerSessionsStartupTimeline.h"
 #include "OnlineSessionSettings.h"
-#include "OnlineSubsystem.h"
 
 void UMenu::MenuSetup(int32 numOfPublicConnections, FString matchType, FString lobbyPath)
 {
@@ -40,11 +40,20 @@ void UMenu::MenuSetup(int32 numOfPublicConnections, FString matchType, FString l
 
   if (MultiplayerSessionsSubsystem)
   {
+    // the menu can be set up again after it was shown, bind every callback only once
+    UnbindSubsystemDelegates();
     MultiplayerSessionsSubsystem->MultiplayerOnCreateSessionComplete.AddDynamic(this, &ThisClass::OnCreateSession);
     MultiplayerSessionsSubsystem->MultiplayerOnFindSessionsComplete.AddUObject(this, &ThisClass::OnFindSessions);
     MultiplayerSessionsSubsystem->MultiplayerOnJoinSessionComplete.AddUObject(this, &ThisClass::OnJoinSession);
     MultiplayerSessionsSubsystem->MultiplayerOnDestroySessionComplete.AddDynamic(this, &ThisClass::OnDestroySession);
     MultiplayerSessionsSubsystem->MultiplayerOnStartSessionComplete.AddDynamic(this, &ThisClass::OnStartSession);
+    MultiplayerSessionsSubsystem->MultiplayerOnJoinQueued.AddUObject(this, &ThisClass::OnJoinQueued);
+  }
+
+  if (!FMultiplayerSessionsStartupTimeline::HasRecorded(TEXT("FirstMenuReady")))
+  {
+    FMultiplayerSessionsStartupTimeline::Record(TEXT("FirstMenuReady"));
+    FMultiplayerSessionsStartupTimeline::Dump();
   }
 }
 
@@ -81,12 +90,14 @@ void UMenu::OnCreateSession(bool bWasSuccessful)
     UWorld* world = GetWorld();
     if (world)
     {
+      MultiplayerSessionsSubsystem->GetTravelProfiler().TravelIssued(true, PathToLobby);
       world->ServerTravel(PathToLobby);
     }
   }
   else
   {
     MultiplayerSessionsDebug::Print("Failed to create session!", FColor::Red);
+    MultiplayerSessionsSubsystem->GetTravelProfiler().CancelTravel(TEXT("the session could not be created"));
     HostButton->SetIsEnabled(true);
   }
 }
@@ -105,34 +116,43 @@ void UMenu::OnFindSessions(const TArray<FOnlineSessionSearchResult>& SessionResu
       return;
     }
   }
-  if (!bWasSuccessful || SessionResults.Num() <= 0)
-  {
-    JoinButton->SetIsEnabled(true);
-  }
+
+  // also when the search found sessions, but none of this match type
+  MultiplayerSessionsSubsystem->GetTravelProfiler().CancelTravel(TEXT("no session was found"));
+  JoinButton->SetIsEnabled(true);
 }
 
 void UMenu::OnJoinSession(EOnJoinSessionCompleteResult::Type Result)
 {
-  IOnlineSubsystem* subsystem = IOnlineSubsystem::Get();
-  if (subsystem)
+  // a session this client is already in is traveled to like a new one
+  if (Result != EOnJoinSessionCompleteResult::Success && Result != EOnJoinSessionCompleteResult::AlreadyInSession)
   {
-    IOnlineSessionPtr sessionInterface = subsystem->GetSessionInterface();
-    if (sessionInterface.IsValid())
+    if (MultiplayerSessionsSubsystem)
     {
-      FString address;
-      sessionInterface->GetResolvedConnectString(NAME_GameSession, address);
-
-      APlayerController* playerController = GetGameInstance()->GetFirstLocalPlayerController();
-      if (playerController)
-      {
-        playerController->ClientTravel(address, ETravelType::TRAVEL_Absolute);
-      }
+      MultiplayerSessionsSubsystem->GetTravelProfiler().CancelTravel(TEXT("the session could not be joined"));
     }
+    JoinButton->SetIsEnabled(true);
+    return;
   }
-  if (Result != EOnJoinSessionCompleteResult::Success)
+
+  // the game session is not always named NAME_GameSession, e.g. after a travel to a pre-joined session
+  FString address;
+  if (MultiplayerSessionsSubsystem && MultiplayerSessionsSubsystem->GetGameSessionConnectString(address))
   {
-    JoinButton->SetIsEnabled(true);
+    APlayerController* playerController = GetGameInstance()->GetFirstLocalPlayerController();
+    if (playerController)
+    {
+      MultiplayerSessionsSubsystem->GetTravelProfiler().TravelIssued(false, address);
+      playerController->ClientTravel(address, ETravelType::TRAVEL_Absolute);
+      return;
+    }
   }
+
+  if (MultiplayerSessionsSubsystem)
+  {
+    MultiplayerSessionsSubsystem->GetTravelProfiler().CancelTravel(TEXT("the joined session has no address"));
+  }
+  JoinButton->SetIsEnabled(true);
 }
 
 void UMenu::OnDestroySession(bool bWasSuccessful)
@@ -143,11 +163,31 @@ void UMenu::OnStartSession(bool bWasSuccessful)
 {
 }
 
+void UMenu::OnJoinQueued(int32 queuePosition)
+{
+  // one message that every retry updates in place
+  static const int32 JoinQueueMessageKey = static_cast<int32>(GetTypeHash(TEXT("MultiplayerSessionsJoinQueue")));
+
+  if (queuePosition == INDEX_NONE)
+  {
+    MultiplayerSessionsDebug::Print("The lobby is still full, stopped waiting", FColor::Red, 6.0f, JoinQueueMessageKey);
+    if (MultiplayerSessionsSubsystem && MultiplayerSessionsSubsystem->GetTravelProfiler().IsTraveling())
+    {
+      MultiplayerSessionsSubsystem->GetTravelProfiler().CancelTravel(TEXT("the join queue was given up"));
+    }
+    JoinButton->SetIsEnabled(true);
+    return;
+  }
+
+  MultiplayerSessionsDebug::Print(FString::Printf(TEXT("The lobby is full, waiting in the queue at position %d"), queuePosition), FColor::Yellow, 6.0f, JoinQueueMessageKey);
+}
+
 void UMenu::HostButtonClicked()
 {
   HostButton->SetIsEnabled(false);
   if (MultiplayerSessionsSubsystem)
   {
+    MultiplayerSessionsSubsystem->GetTravelProfiler().BeginTravel(true);
     MultiplayerSessionsSubsystem->CreateSession(NumPublicConnections, MatchType);
   }
 }
@@ -157,12 +197,27 @@ void UMenu::JoinButtonClicked()
   JoinButton->SetIsEnabled(false);
   if (MultiplayerSessionsSubsystem)
   {
-    MultiplayerSessionsSubsystem->FindSessions(10000);
+    MultiplayerSessionsSubsystem->GetTravelProfiler().BeginTravel(false);
+    MultiplayerSessionsSubsystem->FindSessions(10000, MatchType);
   }
 }
 
+void UMenu::UnbindSubsystemDelegates()
+{
+  if (!MultiplayerSessionsSubsystem) return;
+
+  MultiplayerSessionsSubsystem->MultiplayerOnCreateSessionComplete.RemoveAll(this);
+  MultiplayerSessionsSubsystem->MultiplayerOnFindSessionsComplete.RemoveAll(this);
+  MultiplayerSessionsSubsystem->MultiplayerOnJoinSessionComplete.RemoveAll(this);
+  MultiplayerSessionsSubsystem->MultiplayerOnDestroySessionComplete.RemoveAll(this);
+  MultiplayerSessionsSubsystem->MultiplayerOnStartSessionComplete.RemoveAll(this);
+  MultiplayerSessionsSubsystem->MultiplayerOnJoinQueued.RemoveAll(this);
+}
+
 void UMenu::MenuTeardown()
 {
+  // the subsystem outlives the menu, a closed menu must not travel or keep growing its delegates
+  UnbindSubsystemDelegates();
   RemoveFromParent();
 
   UWorld* world = GetWorld();
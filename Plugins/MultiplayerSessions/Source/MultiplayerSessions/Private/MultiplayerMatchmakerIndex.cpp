@@ -0,0 +1,263 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerMatchmakerIndex.h"
+#include "MultiplayerSessionsReport.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMatchmakerIndex, Log, All);
+
+static FAutoConsoleCommand MatchmakerBenchmarkCommand(
+  TEXT("MultiplayerSessions.Matchmaker.Benchmark"),
+  TEXT("MultiplayerSessions.Matchmaker.Benchmark [NumSessions=100000] [NumQueries=1000000]: registration, heartbeat and match throughput ")
+  TEXT("of the matchmaker index, next to the linear search clients do over a session list"),
+  FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& args)
+    {
+      const int32 numSessions = args.IsValidIndex(0) ? FMath::Max(FCString::Atoi(*args[0]), 1) : 100000;
+      const int32 numQueries = args.IsValidIndex(1) ? FMath::Max(FCString::Atoi(*args[1]), 1) : 1000000;
+      // the linear search takes a full pass per query, a few thousand are enough to measure it
+      const int32 numLinearQueries = FMath::Min(numQueries, 2000);
+
+      static const TCHAR* regions[] = { TEXT("eu"), TEXT("na-east"), TEXT("na-west"), TEXT("sa"), TEXT("asia"), TEXT("oce"), TEXT("me"), TEXT("af") };
+      static const TCHAR* matchTypes[] = { TEXT("FreeForAll"), TEXT("Teams"), TEXT("Ranked"), TEXT("Custom") };
+
+      FRandomStream random(1234);
+      TArray<FMatchmakerSession> sessions;
+      sessions.Reserve(numSessions);
+      for (int32 i = 0; i < numSessions; ++i)
+      {
+        FMatchmakerSession& session = sessions.AddDefaulted_GetRef();
+        session.SessionId = FString::Printf(TEXT("BenchmarkSession%d"), i);
+        session.Region = regions[random.RandHelper(UE_ARRAY_COUNT(regions))];
+        session.MatchType = matchTypes[random.RandHelper(UE_ARRAY_COUNT(matchTypes))];
+        session.NumPublicConnections = 16;
+        session.FreeSlots = random.RandRange(0, session.NumPublicConnections);
+      }
+
+      struct FQuery
+      {
+        const TCHAR* Region;
+        const TCHAR* MatchType;
+        int32 NumPlayers;
+      };
+      TArray<FQuery> queries;
+      queries.Reserve(numQueries);
+      for (int32 i = 0; i < numQueries; ++i)
+      {
+        queries.Add({ regions[random.RandHelper(UE_ARRAY_COUNT(regions))], matchTypes[random.RandHelper(UE_ARRAY_COUNT(matchTypes))], random.RandRange(1, 4) });
+      }
+
+      FMultiplayerSessionsReport report(TEXT("MatchmakerIndex"));
+      report.Root->SetNumberField(TEXT("sessions"), numSessions);
+      const auto addResult = [&report](const TCHAR* operation, int32 count, double seconds)
+        {
+          TSharedRef<FJsonObject> result = report.AddResult();
+          result->SetStringField(TEXT("operation"), operation);
+          result->SetNumberField(TEXT("count"), count);
+          result->SetNumberField(TEXT("seconds"), seconds);
+          result->SetNumberField(TEXT("perSecond"), seconds > 0.0 ? count / seconds : 0.0);
+          result->SetNumberField(TEXT("microsecondsPerOperation"), count > 0 ? seconds * 1000000.0 / count : 0.0);
+          UE_LOG(LogMatchmakerIndex, Display, TEXT("%-12s %9d in %8.3f s, %12.0f/s, %8.3f us each"),
+            operation, count, seconds, seconds > 0.0 ? count / seconds : 0.0, count > 0 ? seconds * 1000000.0 / count : 0.0);
+        };
+
+      FMultiplayerMatchmakerIndex index;
+      double startTime = FPlatformTime::Seconds();
+      for (const FMatchmakerSession& session : sessions)
+      {
+        index.Register(session);
+      }
+      addResult(TEXT("Register"), numSessions, FPlatformTime::Seconds() - startTime);
+
+      // every host sends one heartbeat with its current free slots
+      startTime = FPlatformTime::Seconds();
+      for (FMatchmakerSession& session : sessions)
+      {
+        session.FreeSlots = random.RandRange(0, session.NumPublicConnections);
+        index.Register(session);
+      }
+      addResult(TEXT("Heartbeat"), numSessions, FPlatformTime::Seconds() - startTime);
+
+      int32 numMatched = 0;
+      startTime = FPlatformTime::Seconds();
+      for (const FQuery& query : queries)
+      {
+        numMatched += index.FindBestMatch(query.Region, query.MatchType, query.NumPlayers) ? 1 : 0;
+      }
+      addResult(TEXT("Match"), numQueries, FPlatformTime::Seconds() - startTime);
+
+      int32 numLinearMatched = 0;
+      startTime = FPlatformTime::Seconds();
+      for (int32 i = 0; i < numLinearQueries; ++i)
+      {
+        const FQuery& query = queries[i];
+        const FMatchmakerSession* best = nullptr;
+        for (const FMatchmakerSession& session : sessions)
+        {
+          if (session.FreeSlots >= query.NumPlayers && session.Region == query.Region && session.MatchType == query.MatchType
+            && (!best || session.FreeSlots < best->FreeSlots))
+          {
+            best = &session;
+          }
+        }
+        numLinearMatched += best ? 1 : 0;
+      }
+      addResult(TEXT("LinearMatch"), numLinearQueries, FPlatformTime::Seconds() - startTime);
+
+      report.Root->SetNumberField(TEXT("matched"), numMatched);
+      report.Root->SetNumberField(TEXT("linearMatched"), numLinearMatched);
+      report.Root->SetNumberField(TEXT("indexAllocatedBytes"), static_cast<double>(index.GetAllocatedSize()));
+      report.Save();
+    }));
+
+FString FMultiplayerMatchmakerIndex::GetBucketKey(const FString& region, const FString& matchType)
+{
+  return region + TEXT("|") + matchType;
+}
+
+int32 FMultiplayerMatchmakerIndex::ClampFreeSlots(const FMatchmakerSession& session, int32 freeSlots)
+{
+  return session.NumPublicConnections > 0 ? FMath::Clamp(freeSlots, 0, session.NumPublicConnections) : FMath::Max(freeSlots, 0);
+}
+
+void FMultiplayerMatchmakerIndex::Register(FMatchmakerSession session)
+{
+  session.FreeSlots = ClampFreeSlots(session, session.FreeSlots);
+
+  if (const int32* existingIndex = SessionIndices.Find(session.SessionId))
+  {
+    RemoveFromBucket(*existingIndex);
+    Entries[*existingIndex].Session = session;
+    AddToBucket(*existingIndex);
+    return;
+  }
+
+  FEntry entry;
+  entry.Session = session;
+  const int32 entryIndex = Entries.Add(MoveTemp(entry));
+  SessionIndices.Add(session.SessionId, entryIndex);
+  AddToBucket(entryIndex);
+}
+
+bool FMultiplayerMatchmakerIndex::Unregister(const FString& sessionId)
+{
+  int32 entryIndex = INDEX_NONE;
+  if (!SessionIndices.RemoveAndCopyValue(sessionId, entryIndex)) return false;
+
+  RemoveFromBucket(entryIndex);
+  Entries.RemoveAt(entryIndex);
+  return true;
+}
+
+bool FMultiplayerMatchmakerIndex::ReserveSlots(const FString& sessionId, int32 numPlayers)
+{
+  const int32* entryIndex = SessionIndices.Find(sessionId);
+  if (!entryIndex || Entries[*entryIndex].Session.FreeSlots < numPlayers) return false;
+
+  RemoveFromBucket(*entryIndex);
+  Entries[*entryIndex].Session.FreeSlots -= numPlayers;
+  AddToBucket(*entryIndex);
+  return true;
+}
+
+bool FMultiplayerMatchmakerIndex::ReleaseSlots(const FString& sessionId, int32 numPlayers)
+{
+  const int32* entryIndex = SessionIndices.Find(sessionId);
+  if (!entryIndex || numPlayers <= 0) return false;
+
+  FMatchmakerSession& session = Entries[*entryIndex].Session;
+  RemoveFromBucket(*entryIndex);
+  session.FreeSlots = ClampFreeSlots(session, session.FreeSlots + numPlayers);
+  AddToBucket(*entryIndex);
+  return true;
+}
+
+const FMatchmakerSession* FMultiplayerMatchmakerIndex::FindBestMatch(const FString& region, const FString& matchType, int32 numPlayers) const
+{
+  const int32* bucketIndex = BucketIndices.Find(GetBucketKey(region, matchType));
+  if (!bucketIndex) return nullptr;
+
+  // the first non empty list at or above the slots needed
+  const FBucket& bucket = Buckets[*bucketIndex];
+  const uint64 candidates = bucket.NonEmptySlotLists & (~0ull << GetSlotList(FMath::Max(numPlayers, 1)));
+  if (candidates == 0) return nullptr;
+
+  const TArray<int32>& slotList = bucket.EntriesByFreeSlots[FMath::CountTrailingZeros64(candidates)];
+  return &Entries[slotList.Last()].Session;
+}
+
+int32 FMultiplayerMatchmakerIndex::RemoveExpired(double oldestHeartbeatSeconds)
+{
+  TArray<FString> expiredIds;
+  for (const FEntry& entry : Entries)
+  {
+    if (entry.Session.LastHeartbeatSeconds < oldestHeartbeatSeconds)
+    {
+      expiredIds.Add(entry.Session.SessionId);
+    }
+  }
+
+  for (const FString& sessionId : expiredIds)
+  {
+    Unregister(sessionId);
+  }
+  return expiredIds.Num();
+}
+
+SIZE_T FMultiplayerMatchmakerIndex::GetAllocatedSize() const
+{
+  SIZE_T size = Entries.GetAllocatedSize() + SessionIndices.GetAllocatedSize() + Buckets.GetAllocatedSize() + BucketIndices.GetAllocatedSize();
+  for (const FBucket& bucket : Buckets)
+  {
+    for (const TArray<int32>& slotList : bucket.EntriesByFreeSlots)
+    {
+      size += slotList.GetAllocatedSize();
+    }
+  }
+  return size;
+}
+
+void FMultiplayerMatchmakerIndex::AddToBucket(int32 entryIndex)
+{
+  FEntry& entry = Entries[entryIndex];
+
+  const FString bucketKey = GetBucketKey(entry.Session.Region, entry.Session.MatchType);
+  int32* bucketIndex = BucketIndices.Find(bucketKey);
+  entry.BucketIndex = bucketIndex ? *bucketIndex : BucketIndices.Add(bucketKey, Buckets.AddDefaulted());
+
+  // full sessions stay registered but are never matched
+  if (entry.Session.FreeSlots <= 0)
+  {
+    entry.SlotListPosition = INDEX_NONE;
+    return;
+  }
+
+  FBucket& bucket = Buckets[entry.BucketIndex];
+  const int32 slotList = GetSlotList(entry.Session.FreeSlots);
+  entry.SlotListPosition = bucket.EntriesByFreeSlots[slotList].Add(entryIndex);
+  bucket.NonEmptySlotLists |= 1ull << slotList;
+}
+
+void FMultiplayerMatchmakerIndex::RemoveFromBucket(int32 entryIndex)
+{
+  FEntry& entry = Entries[entryIndex];
+  if (entry.SlotListPosition == INDEX_NONE) return;
+
+  FBucket& bucket = Buckets[entry.BucketIndex];
+  const int32 slotList = GetSlotList(entry.Session.FreeSlots);
+  TArray<int32>& entries = bucket.EntriesByFreeSlots[slotList];
+
+  // the last entry takes the place of the removed one
+  entries.RemoveAtSwap(entry.SlotListPosition, 1, EAllowShrinking::No);
+  if (entries.IsValidIndex(entry.SlotListPosition))
+  {
+    Entries[entries[entry.SlotListPosition]].SlotListPosition = entry.SlotListPosition;
+  }
+  if (entries.Num() == 0)
+  {
+    bucket.NonEmptySlotLists &= ~(1ull << slotList);
+  }
+  entry.SlotListPosition = INDEX_NONE;
+}
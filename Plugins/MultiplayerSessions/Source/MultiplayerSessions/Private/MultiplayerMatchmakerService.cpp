@@ -0,0 +1,224 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerMatchmakerService.h"
+#include "Dom/JsonObject.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "HttpPath.h"
+#include "HttpServerModule.h"
+#include "HttpServerRequest.h"
+#include "HttpServerResponse.h"
+#include "IHttpRouter.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMatchmakerService, Log, All);
+
+// Hosts heartbeat every MultiplayerSessions.MatchmakerHeartbeatSeconds, a few missed ones drop the session
+static float GMatchmakerSessionTimeoutSeconds = 30.0f;
+static FAutoConsoleVariableRef CVarMatchmakerSessionTimeoutSeconds(
+  TEXT("MultiplayerSessions.Matchmaker.SessionTimeoutSeconds"),
+  GMatchmakerSessionTimeoutSeconds,
+  TEXT("Seconds without a heartbeat after which the matchmaker drops a session"));
+
+static TUniquePtr<FMultiplayerMatchmakerService> InProcessMatchmaker;
+
+static FAutoConsoleCommand MatchmakerStartCommand(
+  TEXT("MultiplayerSessions.Matchmaker.Start"),
+  TEXT("MultiplayerSessions.Matchmaker.Start [Port=8090]: serves the matchmaker from this process"),
+  FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& args)
+    {
+      const uint32 port = args.IsValidIndex(0) ? FCString::Atoi(*args[0]) : FMultiplayerMatchmakerService::DefaultPort;
+
+      InProcessMatchmaker = MakeUnique<FMultiplayerMatchmakerService>();
+      if (!InProcessMatchmaker->Start(port))
+      {
+        InProcessMatchmaker.Reset();
+      }
+    }));
+
+static FAutoConsoleCommand MatchmakerStopCommand(
+  TEXT("MultiplayerSessions.Matchmaker.Stop"),
+  TEXT("Stops the matchmaker served from this process"),
+  FConsoleCommandDelegate::CreateLambda([]()
+    {
+      InProcessMatchmaker.Reset();
+    }));
+
+static TSharedPtr<FJsonObject> ParseJsonBody(const FHttpServerRequest& request)
+{
+  const FUTF8ToTCHAR body(reinterpret_cast<const ANSICHAR*>(request.Body.GetData()), request.Body.Num());
+
+  TSharedPtr<FJsonObject> json;
+  TSharedRef<TJsonReader<>> reader = TJsonReaderFactory<>::Create(FString(body.Length(), body.Get()));
+  FJsonSerializer::Deserialize(reader, json);
+  return json;
+}
+
+static bool ParseSlotsBody(const FHttpServerRequest& request, FString& outSessionId, int32& outNumPlayers)
+{
+  const TSharedPtr<FJsonObject> json = ParseJsonBody(request);
+  if (!json.IsValid() || !json->TryGetStringField(TEXT("sessionId"), outSessionId) || outSessionId.IsEmpty()) return false;
+
+  outNumPlayers = 1;
+  json->TryGetNumberField(TEXT("players"), outNumPlayers);
+  outNumPlayers = FMath::Max(outNumPlayers, 1);
+  return true;
+}
+
+FMultiplayerMatchmakerService::~FMultiplayerMatchmakerService()
+{
+  Stop();
+}
+
+bool FMultiplayerMatchmakerService::Start(uint32 port)
+{
+  Router = FHttpServerModule::Get().GetHttpRouter(port, true);
+  if (!Router.IsValid())
+  {
+    UE_LOG(LogMatchmakerService, Error, TEXT("Matchmaker could not listen on port %u"), port);
+    return false;
+  }
+
+  RouteHandles.Add(Router->BindRoute(FHttpPath(TEXT("/sessions/register")), EHttpServerRequestVerbs::VERB_POST,
+    FHttpRequestHandler::CreateRaw(this, &FMultiplayerMatchmakerService::HandleRegister)));
+  RouteHandles.Add(Router->BindRoute(FHttpPath(TEXT("/sessions/unregister")), EHttpServerRequestVerbs::VERB_POST,
+    FHttpRequestHandler::CreateRaw(this, &FMultiplayerMatchmakerService::HandleUnregister)));
+  RouteHandles.Add(Router->BindRoute(FHttpPath(TEXT("/match")), EHttpServerRequestVerbs::VERB_GET,
+    FHttpRequestHandler::CreateRaw(this, &FMultiplayerMatchmakerService::HandleMatch)));
+  RouteHandles.Add(Router->BindRoute(FHttpPath(TEXT("/sessions/reserve")), EHttpServerRequestVerbs::VERB_POST,
+    FHttpRequestHandler::CreateRaw(this, &FMultiplayerMatchmakerService::HandleReserve)));
+  RouteHandles.Add(Router->BindRoute(FHttpPath(TEXT("/sessions/release")), EHttpServerRequestVerbs::VERB_POST,
+    FHttpRequestHandler::CreateRaw(this, &FMultiplayerMatchmakerService::HandleRelease)));
+  FHttpServerModule::Get().StartAllListeners();
+
+  ExpireTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FMultiplayerMatchmakerService::RemoveExpiredSessions), 5.0f);
+
+  UE_LOG(LogMatchmakerService, Display, TEXT("Matchmaker listening on port %u"), port);
+  return true;
+}
+
+void FMultiplayerMatchmakerService::Stop()
+{
+  if (Router.IsValid())
+  {
+    for (const FHttpRouteHandle& routeHandle : RouteHandles)
+    {
+      Router->UnbindRoute(routeHandle);
+    }
+  }
+  RouteHandles.Reset();
+  Router.Reset();
+
+  FTSTicker::GetCoreTicker().RemoveTicker(ExpireTickerHandle);
+  ExpireTickerHandle.Reset();
+}
+
+bool FMultiplayerMatchmakerService::HandleRegister(const FHttpServerRequest& request, const FHttpResultCallback& onComplete)
+{
+  const TSharedPtr<FJsonObject> json = ParseJsonBody(request);
+  FMatchmakerSession session;
+  if (!json.IsValid() || !json->TryGetStringField(TEXT("sessionId"), session.SessionId) || session.SessionId.IsEmpty())
+  {
+    onComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::BadRequest, TEXT("MissingSessionId")));
+    return true;
+  }
+
+  json->TryGetStringField(TEXT("region"), session.Region);
+  json->TryGetStringField(TEXT("matchType"), session.MatchType);
+  json->TryGetNumberField(TEXT("freeSlots"), session.FreeSlots);
+  json->TryGetNumberField(TEXT("numPublicConnections"), session.NumPublicConnections);
+  json->TryGetStringField(TEXT("address"), session.Address);
+  session.LastHeartbeatSeconds = FPlatformTime::Seconds();
+  Index.Register(session);
+
+  onComplete(FHttpServerResponse::Ok());
+  return true;
+}
+
+bool FMultiplayerMatchmakerService::HandleUnregister(const FHttpServerRequest& request, const FHttpResultCallback& onComplete)
+{
+  const TSharedPtr<FJsonObject> json = ParseJsonBody(request);
+  FString sessionId;
+  if (!json.IsValid() || !json->TryGetStringField(TEXT("sessionId"), sessionId))
+  {
+    onComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::BadRequest, TEXT("MissingSessionId")));
+    return true;
+  }
+
+  Index.Unregister(sessionId);
+  onComplete(FHttpServerResponse::Ok());
+  return true;
+}
+
+bool FMultiplayerMatchmakerService::HandleMatch(const FHttpServerRequest& request, const FHttpResultCallback& onComplete)
+{
+  const FString* region = request.QueryParams.Find(TEXT("region"));
+  const FString* matchType = request.QueryParams.Find(TEXT("matchType"));
+  const FString* players = request.QueryParams.Find(TEXT("players"));
+  const int32 numPlayers = players ? FMath::Max(FCString::Atoi(**players), 1) : 1;
+
+  const FMatchmakerSession* match = Index.FindBestMatch(region ? *region : FString(), matchType ? *matchType : FString(), numPlayers);
+  if (!match)
+  {
+    onComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::NotFound, TEXT("NoMatch")));
+    return true;
+  }
+
+  TSharedRef<FJsonObject> json = MakeShared<FJsonObject>();
+  json->SetStringField(TEXT("sessionId"), match->SessionId);
+  json->SetStringField(TEXT("address"), match->Address);
+  json->SetNumberField(TEXT("freeSlots"), match->FreeSlots);
+
+  // the slots are taken when the client confirms the join with /sessions/reserve, a search alone takes none
+  FString output;
+  TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&output);
+  FJsonSerializer::Serialize(json, writer);
+  onComplete(FHttpServerResponse::Create(output, TEXT("application/json")));
+  return true;
+}
+
+bool FMultiplayerMatchmakerService::HandleReserve(const FHttpServerRequest& request, const FHttpResultCallback& onComplete)
+{
+  FString sessionId;
+  int32 numPlayers = 1;
+  if (!ParseSlotsBody(request, sessionId, numPlayers))
+  {
+    onComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::BadRequest, TEXT("MissingSessionId")));
+    return true;
+  }
+
+  if (!Index.ReserveSlots(sessionId, numPlayers))
+  {
+    onComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::NotFound, TEXT("NoFreeSlots")));
+    return true;
+  }
+  onComplete(FHttpServerResponse::Ok());
+  return true;
+}
+
+bool FMultiplayerMatchmakerService::HandleRelease(const FHttpServerRequest& request, const FHttpResultCallback& onComplete)
+{
+  FString sessionId;
+  int32 numPlayers = 1;
+  if (!ParseSlotsBody(request, sessionId, numPlayers))
+  {
+    onComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::BadRequest, TEXT("MissingSessionId")));
+    return true;
+  }
+
+  Index.ReleaseSlots(sessionId, numPlayers);
+  onComplete(FHttpServerResponse::Ok());
+  return true;
+}
+
+bool FMultiplayerMatchmakerService::RemoveExpiredSessions(float deltaTime)
+{
+  const int32 numRemoved = Index.RemoveExpired(FPlatformTime::Seconds() - GMatchmakerSessionTimeoutSeconds);
+  if (numRemoved > 0)
+  {
+    UE_LOG(LogMatchmakerService, Display, TEXT("Matchmaker dropped %d sessions without heartbeat, %d registered"), numRemoved, Index.Num());
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "HttpResultCallback.h"
+#include "HttpRouteHandle.h"
+#include "MultiplayerMatchmakerIndex.h"
+
+class IHttpRouter;
+struct FHttpServerRequest;
+
+/**
+ * Serves FMultiplayerMatchmakerIndex over HTTP, run by the Matchmaker commandlet or inside a host with
+ * MultiplayerSessions.Matchmaker.Start. Hosts POST /sessions/register as heartbeat and /sessions/unregister when
+ * the session ends, clients GET /match?region=&matchType=&players= and receive the session id and host address to
+ * join. Clients POST /sessions/reserve once they joined and /sessions/release when they did not make it in.
+ */
+class FMultiplayerMatchmakerService
+{
+public:
+  static constexpr uint32 DefaultPort = 8090;
+
+  ~FMultiplayerMatchmakerService();
+
+  bool Start(uint32 port);
+  void Stop();
+
+  const FMultiplayerMatchmakerIndex& GetIndex() const { return Index; }
+
+private:
+  bool HandleRegister(const FHttpServerRequest& request, const FHttpResultCallback& onComplete);
+  bool HandleUnregister(const FHttpServerRequest& request, const FHttpResultCallback& onComplete);
+  bool HandleMatch(const FHttpServerRequest& request, const FHttpResultCallback& onComplete);
+  bool HandleReserve(const FHttpServerRequest& request, const FHttpResultCallback& onComplete);
+  bool HandleRelease(const FHttpServerRequest& request, const FHttpResultCallback& onComplete);
+  bool RemoveExpiredSessions(float deltaTime);
+
+private:
+  FMultiplayerMatchmakerIndex Index;
+  TSharedPtr<IHttpRouter> Router;
+  TArray<FHttpRouteHandle> RouteHandles;
+  FTSTicker::FDelegateHandle ExpireTickerHandle;
+};
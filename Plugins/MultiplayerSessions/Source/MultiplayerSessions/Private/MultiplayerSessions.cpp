@@ -1,18 +1,27 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "MultiplayerSessions.h"
+#include "MultiplayerSessionsStartupTimeline.h"
+#include "Misc/CoreDelegates.h"
 
 #define LOCTEXT_NAMESPACE "FMultiplayerSessionsModule"
 
 void FMultiplayerSessionsModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+	FMultiplayerSessionsStartupTimeline::Record(TEXT("MultiplayerSessionsModuleLoaded"));
+
+	EngineInitCompleteHandle = FCoreDelegates::OnFEngineLoopInitComplete.AddLambda([]()
+		{
+			FMultiplayerSessionsStartupTimeline::Record(TEXT("EngineInitComplete"));
+		});
 }
 
 void FMultiplayerSessionsModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	FCoreDelegates::OnFEngineLoopInitComplete.Remove(EngineInitCompleteHandle);
 }
 
 #undef LOCTEXT_NAMESPACE
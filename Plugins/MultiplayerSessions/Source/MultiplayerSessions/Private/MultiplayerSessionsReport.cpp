@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerSessionsReport.h"
+#include "HAL/FileManager.h"
+#include "Misc/App.h"
+#include "Misc/DateTime.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMultiplayerSessionsReport, Log, All);
+
+FMultiplayerSessionsReport::FMultiplayerSessionsReport(const FString& name) :
+  Name(name),
+  Root(MakeShared<FJsonObject>())
+{
+  Root->SetStringField(TEXT("benchmark"), Name);
+  Root->SetStringField(TEXT("buildVersion"), FApp::GetBuildVersion());
+  Root->SetStringField(TEXT("engineVersion"), FEngineVersion::Current().ToString());
+  Root->SetStringField(TEXT("buildConfiguration"), LexToString(FApp::GetBuildConfiguration()));
+  Root->SetStringField(TEXT("platform"), FPlatformProperties::IniPlatformName());
+  Root->SetStringField(TEXT("timestamp"), FDateTime::UtcNow().ToIso8601());
+}
+
+TSharedRef<FJsonObject> FMultiplayerSessionsReport::AddResult()
+{
+  TSharedRef<FJsonObject> result = MakeShared<FJsonObject>();
+  Results.Add(MakeShared<FJsonValueObject>(result));
+  return result;
+}
+
+FString FMultiplayerSessionsReport::Save() const
+{
+  Root->SetArrayField(TEXT("results"), Results);
+
+  FString output;
+  TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&output);
+  if (!FJsonSerializer::Serialize(Root, writer)) return FString();
+
+  const FString directory = FPaths::ProjectSavedDir() / TEXT("Benchmarks");
+  IFileManager::Get().MakeDirectory(*directory, true);
+
+  const FString path = directory / FString::Printf(TEXT("%s-%s.json"), *Name, *FDateTime::Now().ToString());
+  if (!FFileHelper::SaveStringToFile(output, *path)) return FString();
+
+  UE_LOG(LogMultiplayerSessionsReport, Display, TEXT("Report written to %s"), *path);
+  return path;
+}
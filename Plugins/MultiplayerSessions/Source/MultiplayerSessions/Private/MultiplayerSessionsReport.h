@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Dom/JsonObject.h"
+
+/**
+ * Writes reports of the sessions plugin to Saved/Benchmarks/<Name>-<Timestamp>.json, in the same layout as the
+ * benchmark reports of the game so the same tools read both
+ */
+struct FMultiplayerSessionsReport
+{
+  explicit FMultiplayerSessionsReport(const FString& name);
+
+  // Adds an entry to the "results" array of the report
+  TSharedRef<FJsonObject> AddResult();
+
+  // Returns the path of the written file, empty on failure
+  FString Save() const;
+
+  FString Name;
+  TSharedRef<FJsonObject> Root;
+  TArray<TSharedPtr<FJsonValue>> Results;
+};
@@ -0,0 +1,330 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerSessionsSoakTest.h"
+#include "InMemoryOnlineSession.h"
+#include "Menu.h"
+#include "MultiplayerSessionsReport.h"
+#include "MultiplayerSessionsSubsystem.h"
+#include "Engine/GameInstance.h"
+#include "Engine/LocalPlayer.h"
+#include "Blueprint/UserWidget.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/CommandLine.h"
+#include "UObject/UObjectArray.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSessionSoak, Log, All);
+
+static const FName SoakJoinSessionName(TEXT("SoakJoinSession"));
+
+// The create, find, join, destroy, start and join queue callbacks of the menu
+static const int32 MenuDelegateBindings = 6;
+
+static TUniquePtr<FMultiplayerSessionsSoakTest> SoakTest;
+
+static FAutoConsoleCommandWithWorldAndArgs SoakCommand(
+  TEXT("MultiplayerSessions.Soak"),
+  TEXT("MultiplayerSessions.Soak [Cycles=5000] [CyclesPerFrame=10] [MaxMemoryGrowthMB=8] [MaxObjectGrowth=100] [MaxDelegateGrowth=0]: ")
+  TEXT("menu setup and teardown, create, find, join and destroy cycles against an in-memory session backend, fails when memory, objects or delegates grow. ")
+  TEXT("Run from the main menu, sessions of the online subsystem are dropped. -SoakExit exits with the result when done"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UGameInstance* gameInstance = world ? world->GetGameInstance() : nullptr;
+      UMultiplayerSessionsSubsystem* subsystem = gameInstance ? gameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+      if (!subsystem) return;
+
+      // the subsystem issues every operation for the first local player
+      const ULocalPlayer* localPlayer = world->GetFirstLocalPlayerFromController();
+      if (!localPlayer || !localPlayer->GetPreferredUniqueNetId().IsValid())
+      {
+        UE_LOG(LogSessionSoak, Error, TEXT("The soak test needs a local player with a unique net id"));
+        return;
+      }
+
+      if (SoakTest && SoakTest->IsRunning())
+      {
+        UE_LOG(LogSessionSoak, Warning, TEXT("A soak test is already running"));
+        return;
+      }
+
+      FMultiplayerSessionsSoakTest::FSettings settings;
+      if (args.IsValidIndex(0)) settings.Cycles = FMath::Max(FCString::Atoi(*args[0]), 1);
+      if (args.IsValidIndex(1)) settings.CyclesPerFrame = FMath::Max(FCString::Atoi(*args[1]), 1);
+      if (args.IsValidIndex(2)) settings.MaxMemoryGrowthMB = FCString::Atod(*args[2]);
+      if (args.IsValidIndex(3)) settings.MaxObjectGrowth = FCString::Atoi(*args[3]);
+      if (args.IsValidIndex(4)) settings.MaxDelegateGrowth = FCString::Atoi(*args[4]);
+      settings.WarmupCycles = FMath::Min(settings.WarmupCycles, settings.Cycles / 10);
+      settings.bExitWhenDone = FParse::Param(FCommandLine::Get(), TEXT("SoakExit"));
+
+      SoakTest.Reset();
+      SoakTest = MakeUnique<FMultiplayerSessionsSoakTest>(subsystem, settings);
+    }));
+
+FMultiplayerSessionsSoakTest::FMultiplayerSessionsSoakTest(UMultiplayerSessionsSubsystem* subsystem, const FSettings& settings) :
+  Subsystem(subsystem),
+  Backend(MakeShared<FInMemoryOnlineSession>()),
+  Settings(settings)
+{
+  // about 50 samples over the run
+  SampleInterval = FMath::Max(Settings.Cycles / 50, 1);
+  StartTime = FPlatformTime::Seconds();
+
+  subsystem->SetSessionInterfaceOverride(Backend);
+  subsystem->GetNamedSession(NAME_GameSession).OnCreateSessionComplete.AddRaw(this, &FMultiplayerSessionsSoakTest::OnSessionComplete);
+  subsystem->GetNamedSession(NAME_GameSession).OnDestroySessionComplete.AddRaw(this, &FMultiplayerSessionsSoakTest::OnSessionComplete);
+  subsystem->GetNamedSession(SoakJoinSessionName).OnJoinSessionComplete.AddRaw(this, &FMultiplayerSessionsSoakTest::OnJoinSessionComplete);
+  subsystem->GetNamedSession(SoakJoinSessionName).OnDestroySessionComplete.AddRaw(this, &FMultiplayerSessionsSoakTest::OnSessionComplete);
+  subsystem->MultiplayerOnFindSessionsComplete.AddRaw(this, &FMultiplayerSessionsSoakTest::OnFindSessionsComplete);
+
+  UE_LOG(LogSessionSoak, Display, TEXT("Session soak test started, %d cycles, %d per frame"), Settings.Cycles, Settings.CyclesPerFrame);
+  TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FMultiplayerSessionsSoakTest::Tick));
+}
+
+FMultiplayerSessionsSoakTest::~FMultiplayerSessionsSoakTest()
+{
+  if (TickerHandle.IsValid())
+  {
+    FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+    TickerHandle.Reset();
+    RestoreSessionInterface();
+  }
+}
+
+void FMultiplayerSessionsSoakTest::RestoreSessionInterface()
+{
+  // also drops the per session delegates bound above
+  if (UMultiplayerSessionsSubsystem* subsystem = Subsystem.Get())
+  {
+    subsystem->MultiplayerOnFindSessionsComplete.RemoveAll(this);
+    subsystem->SetSessionInterfaceOverride(nullptr);
+  }
+  Subsystem.Reset();
+}
+
+bool FMultiplayerSessionsSoakTest::Tick(float deltaTime)
+{
+  if (!Subsystem.IsValid())
+  {
+    UE_LOG(LogSessionSoak, Error, TEXT("Session soak test aborted, the sessions subsystem went away after %d cycles"), NumCyclesRun);
+    TickerHandle.Reset();
+    return false;
+  }
+
+  for (int32 i = 0; i < Settings.CyclesPerFrame && NumCyclesRun < Settings.Cycles; ++i)
+  {
+    if (!RunCycle())
+    {
+      ++NumFailedCycles;
+    }
+    ++NumCyclesRun;
+
+    if (NumCyclesRun == Settings.WarmupCycles)
+    {
+      Baseline = TakeSample(true);
+      Samples.Add(*Baseline);
+    }
+    else if (NumCyclesRun % SampleInterval == 0 && NumCyclesRun < Settings.Cycles)
+    {
+      Samples.Add(TakeSample(false));
+    }
+  }
+
+  if (NumCyclesRun < Settings.Cycles) return true;
+
+  Finish();
+  return false;
+}
+
+bool FMultiplayerSessionsSoakTest::RunCycle()
+{
+  UMultiplayerSessionsSubsystem* subsystem = Subsystem.Get();
+  const int32 completionsBefore = NumCompletions;
+  bool bSucceeded = true;
+
+  // a menu set up again binds every callback once, torn down it binds none; it is gone before any session
+  // operation, its callbacks would travel
+  if (UMenu* menu = CreateWidget<UMenu>(subsystem->GetGameInstance(), UMenu::StaticClass()))
+  {
+    menu->MenuSetup();
+    menu->MenuSetup();
+    bSucceeded &= subsystem->GetNumMultiplayerDelegateBindings(menu) == MenuDelegateBindings;
+    menu->MenuTeardown();
+
+    const int32 leakedBindings = subsystem->GetNumMultiplayerDelegateBindings(menu);
+    NumLeakedMenuBindings += leakedBindings;
+    bSucceeded &= leakedBindings == 0;
+  }
+  else
+  {
+    bSucceeded = false;
+  }
+
+  subsystem->CreateSession(4, TEXT("Soak"), NAME_GameSession);
+  Backend->Flush();
+  bSucceeded &= Backend->GetNamedSession(NAME_GameSession) != nullptr;
+
+  LastSearchResults.Reset();
+  subsystem->FindSessions(10);
+  Backend->Flush();
+  bSucceeded &= LastSearchResults.Num() > 0;
+
+  if (LastSearchResults.Num() > 0)
+  {
+    subsystem->JoinSession(LastSearchResults[0], SoakJoinSessionName);
+    Backend->Flush();
+    bSucceeded &= Backend->GetNamedSession(SoakJoinSessionName) != nullptr;
+  }
+  LastSearchResults.Reset();
+
+  // destroyed even after a failed step, every cycle starts without sessions
+  if (Backend->GetNamedSession(SoakJoinSessionName))
+  {
+    subsystem->DestroySession(SoakJoinSessionName);
+  }
+  subsystem->DestroySession(NAME_GameSession);
+  Backend->Flush();
+
+  // create, join and both destroys
+  bSucceeded &= Backend->GetNumSessions() == 0 && NumCompletions - completionsBefore == 4;
+  return bSucceeded;
+}
+
+FMultiplayerSessionsSoakTest::FSample FMultiplayerSessionsSoakTest::TakeSample(bool bCollectGarbage) const
+{
+  // objects waiting for the next collection would look like growth
+  if (bCollectGarbage)
+  {
+    CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+  }
+
+  FSample sample;
+  sample.Cycle = NumCyclesRun;
+  sample.Seconds = FPlatformTime::Seconds() - StartTime;
+  sample.UsedPhysicalBytes = FPlatformMemory::GetStats().UsedPhysical;
+  sample.NumObjects = GUObjectArray.GetObjectArrayNumMinusAvailable();
+  sample.NumBackendDelegates = Backend->GetNumBoundDelegates();
+  sample.SubsystemDelegateBytes = Subsystem.IsValid() ? Subsystem->GetDelegateAllocatedSize() : 0;
+  sample.BackendBytes = Backend->GetAllocatedSize();
+  sample.NumNamedSessions = Subsystem.IsValid() ? Subsystem->GetNumNamedSessions() : 0;
+  return sample;
+}
+
+void FMultiplayerSessionsSoakTest::Finish()
+{
+  TickerHandle.Reset();
+
+  const FSample last = TakeSample(true);
+  Samples.Add(last);
+  const FSample baseline = Baseline.Get(Samples[0]);
+
+  TArray<FString> failures;
+  if (NumFailedCycles > 0)
+  {
+    failures.Add(FString::Printf(TEXT("%d of %d cycles failed"), NumFailedCycles, NumCyclesRun));
+  }
+
+  const double memoryGrowthMB = (static_cast<double>(last.UsedPhysicalBytes) - static_cast<double>(baseline.UsedPhysicalBytes)) / (1024.0 * 1024.0);
+  if (memoryGrowthMB > Settings.MaxMemoryGrowthMB)
+  {
+    failures.Add(FString::Printf(TEXT("used memory grew by %.2f MB, limit %.2f MB"), memoryGrowthMB, Settings.MaxMemoryGrowthMB));
+  }
+
+  const int32 objectGrowth = last.NumObjects - baseline.NumObjects;
+  if (objectGrowth > Settings.MaxObjectGrowth)
+  {
+    failures.Add(FString::Printf(TEXT("UObjects grew by %d, limit %d"), objectGrowth, Settings.MaxObjectGrowth));
+  }
+
+  if (NumLeakedMenuBindings > 0)
+  {
+    failures.Add(FString::Printf(TEXT("torn down menus left %d bindings to the subsystem delegates"), NumLeakedMenuBindings));
+  }
+
+  const int32 delegateGrowth = last.NumBackendDelegates - baseline.NumBackendDelegates;
+  if (delegateGrowth > Settings.MaxDelegateGrowth)
+  {
+    failures.Add(FString::Printf(TEXT("delegates bound to the session interface grew by %d, limit %d"), delegateGrowth, Settings.MaxDelegateGrowth));
+  }
+
+  // the cycles reuse the same session names and listeners, any growth here is a leak
+  if (last.SubsystemDelegateBytes > baseline.SubsystemDelegateBytes || last.NumNamedSessions > baseline.NumNamedSessions)
+  {
+    failures.Add(FString::Printf(TEXT("subsystem bookkeeping grew from %d sessions, %llu bytes to %d sessions, %llu bytes"),
+      baseline.NumNamedSessions, static_cast<uint64>(baseline.SubsystemDelegateBytes), last.NumNamedSessions, static_cast<uint64>(last.SubsystemDelegateBytes)));
+  }
+
+  const double seconds = last.Seconds;
+  if (failures.Num() > 0)
+  {
+    UE_LOG(LogSessionSoak, Error, TEXT("Session soak test failed after %d cycles in %.1f s: %s"), NumCyclesRun, seconds, *FString::Join(failures, TEXT("; ")));
+  }
+  else
+  {
+    UE_LOG(LogSessionSoak, Display, TEXT("Session soak test passed, %d cycles in %.1f s, memory %+.2f MB, objects %+d, delegates %+d"),
+      NumCyclesRun, seconds, memoryGrowthMB, objectGrowth, delegateGrowth);
+  }
+
+  WriteReport(failures);
+  RestoreSessionInterface();
+
+  if (Settings.bExitWhenDone)
+  {
+    FPlatformMisc::RequestExitWithStatus(false, failures.Num() > 0 ? 1 : 0);
+  }
+}
+
+void FMultiplayerSessionsSoakTest::WriteReport(const TArray<FString>& failures) const
+{
+  FMultiplayerSessionsReport report(TEXT("SessionSoak"));
+  report.Root->SetNumberField(TEXT("cycles"), NumCyclesRun);
+  report.Root->SetNumberField(TEXT("failedCycles"), NumFailedCycles);
+  report.Root->SetNumberField(TEXT("leakedMenuBindings"), NumLeakedMenuBindings);
+  report.Root->SetNumberField(TEXT("warmupCycles"), Settings.WarmupCycles);
+  report.Root->SetNumberField(TEXT("maxMemoryGrowthMB"), Settings.MaxMemoryGrowthMB);
+  report.Root->SetNumberField(TEXT("maxObjectGrowth"), Settings.MaxObjectGrowth);
+  report.Root->SetNumberField(TEXT("maxDelegateGrowth"), Settings.MaxDelegateGrowth);
+  report.Root->SetBoolField(TEXT("passed"), failures.Num() == 0);
+
+  TArray<TSharedPtr<FJsonValue>> failureValues;
+  for (const FString& failure : failures)
+  {
+    failureValues.Add(MakeShared<FJsonValueString>(failure));
+  }
+  report.Root->SetArrayField(TEXT("failures"), failureValues);
+
+  for (const FSample& sample : Samples)
+  {
+    TSharedRef<FJsonObject> result = report.AddResult();
+    result->SetNumberField(TEXT("cycle"), sample.Cycle);
+    result->SetNumberField(TEXT("seconds"), sample.Seconds);
+    result->SetNumberField(TEXT("usedPhysicalMB"), static_cast<double>(sample.UsedPhysicalBytes) / (1024.0 * 1024.0));
+    result->SetNumberField(TEXT("objects"), sample.NumObjects);
+    result->SetNumberField(TEXT("sessionInterfaceDelegates"), sample.NumBackendDelegates);
+    result->SetNumberField(TEXT("subsystemDelegateBytes"), static_cast<double>(sample.SubsystemDelegateBytes));
+    result->SetNumberField(TEXT("backendBytes"), static_cast<double>(sample.BackendBytes));
+    result->SetNumberField(TEXT("namedSessions"), sample.NumNamedSessions);
+  }
+  report.Save();
+}
+
+void FMultiplayerSessionsSoakTest::OnSessionComplete(FName sessionName, bool bWasSuccessful)
+{
+  NumCompletions += bWasSuccessful ? 1 : 0;
+}
+
+void FMultiplayerSessionsSoakTest::OnJoinSessionComplete(FName sessionName, EOnJoinSessionCompleteResult::Type result)
+{
+  NumCompletions += result == EOnJoinSessionCompleteResult::Success ? 1 : 0;
+}
+
+void FMultiplayerSessionsSoakTest::OnFindSessionsComplete(const TArray<FOnlineSessionSearchResult>& sessionResults, bool bWasSuccessful)
+{
+  if (bWasSuccessful)
+  {
+    LastSearchResults = sessionResults;
+  }
+}
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Interfaces/OnlineSessionInterface.h"
+
+class FInMemoryOnlineSession;
+class UMultiplayerSessionsSubsystem;
+
+/**
+ * Churns UMultiplayerSessionsSubsystem through create, find, join and destroy cycles against FInMemoryOnlineSession
+ * and fails when memory, UObjects or bound delegates keep growing with the cycles. Every cycle also sets up a UMenu
+ * twice and tears it down, counting its bindings to the Multiplayer* delegates. Started with MultiplayerSessions.Soak,
+ * the samples are written to Saved/Benchmarks/SessionSoak-*.json.
+ */
+class FMultiplayerSessionsSoakTest
+{
+public:
+  struct FSettings
+  {
+    int32 Cycles = 5000;
+    int32 CyclesPerFrame = 10;
+    // Cycles before the baseline is taken, so allocations that are made once are not counted as growth
+    int32 WarmupCycles = 100;
+    double MaxMemoryGrowthMB = 8.0;
+    int32 MaxObjectGrowth = 100;
+    int32 MaxDelegateGrowth = 0;
+    // Exits the process with a non zero code when the soak test fails, for automation
+    bool bExitWhenDone = false;
+  };
+
+  FMultiplayerSessionsSoakTest(UMultiplayerSessionsSubsystem* subsystem, const FSettings& settings);
+  ~FMultiplayerSessionsSoakTest();
+
+  bool IsRunning() const { return TickerHandle.IsValid(); }
+
+private:
+  struct FSample
+  {
+    int32 Cycle = 0;
+    double Seconds = 0.0;
+    uint64 UsedPhysicalBytes = 0;
+    int32 NumObjects = 0;
+    int32 NumBackendDelegates = 0;
+    SIZE_T SubsystemDelegateBytes = 0;
+    SIZE_T BackendBytes = 0;
+    int32 NumNamedSessions = 0;
+  };
+
+  bool Tick(float deltaTime);
+  bool RunCycle();
+  FSample TakeSample(bool bCollectGarbage) const;
+  void Finish();
+  void RestoreSessionInterface();
+  void WriteReport(const TArray<FString>& failures) const;
+
+  void OnSessionComplete(FName sessionName, bool bWasSuccessful);
+  void OnJoinSessionComplete(FName sessionName, EOnJoinSessionCompleteResult::Type result);
+  void OnFindSessionsComplete(const TArray<FOnlineSessionSearchResult>& sessionResults, bool bWasSuccessful);
+
+private:
+  TWeakObjectPtr<UMultiplayerSessionsSubsystem> Subsystem;
+  TSharedRef<FInMemoryOnlineSession> Backend;
+  FSettings Settings;
+  FTSTicker::FDelegateHandle TickerHandle;
+
+  int32 NumCyclesRun = 0;
+  int32 NumFailedCycles = 0;
+  int32 NumCompletions = 0;
+  // Bindings to the Multiplayer* delegates the menus still had after their teardown
+  int32 NumLeakedMenuBindings = 0;
+  int32 SampleInterval = 1;
+  double StartTime = 0.0;
+  TArray<FOnlineSessionSearchResult> LastSearchResults;
+
+  TOptional<FSample> Baseline;
+  TArray<FSample> Samples;
+};
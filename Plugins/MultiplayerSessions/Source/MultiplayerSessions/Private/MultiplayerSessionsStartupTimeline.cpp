@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerSessionsStartupTimeline.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogStartupTimeline, Log, All);
+
+namespace
+{
+  struct FStartupMilestone
+  {
+    FName Name;
+    double SecondsSinceStart = 0.0;
+    double DurationSeconds = 0.0;
+  };
+
+  FCriticalSection MilestonesLock;
+  TArray<FStartupMilestone> Milestones;
+}
+
+static FAutoConsoleCommand StartupTimelineCommand(
+  TEXT("MultiplayerSessions.StartupTimeline"),
+  TEXT("Prints the cold start milestones of this process"),
+  FConsoleCommandDelegate::CreateStatic(&FMultiplayerSessionsStartupTimeline::Dump));
+
+void FMultiplayerSessionsStartupTimeline::Record(FName milestone, double durationSeconds)
+{
+  {
+    FScopeLock lock(&MilestonesLock);
+    if (Milestones.ContainsByPredicate([milestone](const FStartupMilestone& entry) { return entry.Name == milestone; })) return;
+
+    Milestones.Add({ milestone, FPlatformTime::Seconds() - GStartTime, durationSeconds });
+  }
+
+  TRACE_BOOKMARK(TEXT("Startup: %s"), *milestone.ToString());
+}
+
+bool FMultiplayerSessionsStartupTimeline::HasRecorded(FName milestone)
+{
+  FScopeLock lock(&MilestonesLock);
+  return Milestones.ContainsByPredicate([milestone](const FStartupMilestone& entry) { return entry.Name == milestone; });
+}
+
+void FMultiplayerSessionsStartupTimeline::Dump()
+{
+  FScopeLock lock(&MilestonesLock);
+
+  UE_LOG(LogStartupTimeline, Display, TEXT("Startup timeline, seconds since process start:"));
+  double previousSeconds = 0.0;
+  for (const FStartupMilestone& milestone : Milestones)
+  {
+    if (milestone.DurationSeconds > 0.0)
+    {
+      UE_LOG(LogStartupTimeline, Display, TEXT("  %8.3f (+%.3f) %s, took %.1f ms"),
+        milestone.SecondsSinceStart, milestone.SecondsSinceStart - previousSeconds, *milestone.Name.ToString(), milestone.DurationSeconds * 1000.0);
+    }
+    else
+    {
+      UE_LOG(LogStartupTimeline, Display, TEXT("  %8.3f (+%.3f) %s"),
+        milestone.SecondsSinceStart, milestone.SecondsSinceStart - previousSeconds, *milestone.Name.ToString());
+    }
+    previousSeconds = milestone.SecondsSinceStart;
+  }
+}
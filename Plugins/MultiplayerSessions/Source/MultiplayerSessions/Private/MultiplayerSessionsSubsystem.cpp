@@ -2,138 +2,712 @@
 
 
 #include "MultiplayerSessionsSubsystem.h"
+#include "MultiplayerSessionsStartupTimeline.h"
+#include "Dom/JsonObject.h"
+#include "Engine/Engine.h"
+#include "Engine/PendingNetGame.h"
+#include "Engine/World.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/GameSession.h"
+#include "GameFramework/PlayerState.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "HttpModule.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
 #include "OnlineSubsystem.h"
 #include "OnlineSessionSettings.h"
 #include "Online/OnlineSessionNames.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMultiplayerSessions, Log, All);
+
+static FString GMatchmakerUrl;
+static FAutoConsoleVariableRef CVarMatchmakerUrl(
+  TEXT("MultiplayerSessions.MatchmakerUrl"),
+  GMatchmakerUrl,
+  TEXT("Base URL of the matchmaker, e.g. http://127.0.0.1:8090. Hosts register their game session with it and clients search through it, empty uses the online subsystem only"));
+
+static FString GMatchmakerRegion = TEXT("default");
+static FAutoConsoleVariableRef CVarMatchmakerRegion(
+  TEXT("MultiplayerSessions.Region"),
+  GMatchmakerRegion,
+  TEXT("Region the game session is registered in and searched for with the matchmaker"));
+
+static float GMatchmakerHeartbeatSeconds = 10.0f;
+static FAutoConsoleVariableRef CVarMatchmakerHeartbeatSeconds(
+  TEXT("MultiplayerSessions.MatchmakerHeartbeatSeconds"),
+  GMatchmakerHeartbeatSeconds,
+  TEXT("Seconds between the registrations of a host with the matchmaker, they also update its free slots"));
+
+static FAutoConsoleCommandWithWorldAndArgs PrepareNextMatchCommand(
+  TEXT("MultiplayerSessions.PrepareNextMatch"),
+  TEXT("MultiplayerSessions.PrepareNextMatch [NumPublicConnections=4] [MatchType=FreeForAll]: sets the session settings of the next match on the host"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UMultiplayerSessionsSubsystem* subsystem = world && world->GetGameInstance() ? world->GetGameInstance()->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+      if (!subsystem) return;
+
+      subsystem->PrepareNextMatch(args.IsValidIndex(0) ? FCString::Atoi(*args[0]) : 4, args.IsValidIndex(1) ? args[1] : FString(TEXT("FreeForAll")));
+    }));
+
+static FAutoConsoleCommandWithWorldAndArgs StartNextMatchCommand(
+  TEXT("MultiplayerSessions.StartNextMatch"),
+  TEXT("MultiplayerSessions.StartNextMatch [Url=/Game/ThirdPerson/Maps/Lobby?listen]: ends the match on the host and travels into the next one"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UMultiplayerSessionsSubsystem* subsystem = world && world->GetGameInstance() ? world->GetGameInstance()->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+      if (!subsystem) return;
+
+      subsystem->StartNextMatch(args.IsValidIndex(0) ? args[0] : FString(TEXT("/Game/ThirdPerson/Maps/Lobby?listen")));
+    }));
+
+static void PostToMatchmaker(const FString& path, const TSharedRef<FJsonObject>& json)
+{
+  FString body;
+  TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&body);
+  FJsonSerializer::Serialize(json, writer);
+
+  TSharedRef<IHttpRequest, ESPMode::ThreadSafe> request = FHttpModule::Get().CreateRequest();
+  request->SetURL(GMatchmakerUrl + path);
+  request->SetVerb(TEXT("POST"));
+  request->SetHeader(TEXT("Content-Type"), TEXT("application/json"));
+  request->SetContentAsString(body);
+  request->ProcessRequest();
+}
 
 UMultiplayerSessionsSubsystem::UMultiplayerSessionsSubsystem() :
   CreateSessionCompleteDelegate(FOnCreateSessionCompleteDelegate::CreateUObject(this, &ThisClass::OnCreateSessionComplete)),
   FindSessionsCompleteDelegate(FOnFindSessionsCompleteDelegate::CreateUObject(this, &ThisClass::OnFindSessionsComplete)),
   JoinSessionCompleteDelegate(FOnJoinSessionCompleteDelegate::CreateUObject(this, &ThisClass::OnJoinSessionComplete)),
   DestroySessionCompleteDelegate(FOnDestroySessionCompleteDelegate::CreateUObject(this, &ThisClass::OnDestroySessionComplete)),
-  StartSessionCompleteDelegate(FOnStartSessionCompleteDelegate::CreateUObject(this, &ThisClass::OnStartSessionComplete))
+  StartSessionCompleteDelegate(FOnStartSessionCompleteDelegate::CreateUObject(this, &ThisClass::OnStartSessionComplete)),
+  UpdateSessionCompleteDelegate(FOnUpdateSessionCompleteDelegate::CreateUObject(this, &ThisClass::OnUpdateSessionComplete))
 {
+}
+
+void UMultiplayerSessionsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+  Super::Initialize(Collection);
+
+  // the online subsystem is resolved by the first session operation, not during startup
+  FMultiplayerSessionsStartupTimeline::Record(TEXT("SessionsSubsystemInitialized"));
+
+  if (GEngine)
+  {
+    NetworkFailureHandle = GEngine->OnNetworkFailure().AddUObject(this, &ThisClass::OnNetworkFailure);
+  }
+  TravelProfiler.Initialize(GetGameInstance());
+  WorldInitializedActorsHandle = FWorldDelegates::OnWorldInitializedActors.AddUObject(this, &ThisClass::OnWorldInitializedActors);
+  WorldCleanupHandle = FWorldDelegates::OnWorldCleanup.AddUObject(this, &ThisClass::OnWorldCleanup);
+}
+
+IOnlineSessionPtr UMultiplayerSessionsSubsystem::GetSessionInterface()
+{
+  if (bSessionInterfaceResolved) return SessionInterface;
+  bSessionInterfaceResolved = true;
+
+  const double startTime = FPlatformTime::Seconds();
+
   IOnlineSubsystem* subsystem = IOnlineSubsystem::Get();
+  if (!subsystem || !subsystem->GetSessionInterface().IsValid())
+  {
+    // Steam is not running or was disabled with -nosteam, LAN sessions still work
+    subsystem = IOnlineSubsystem::Get(NULL_SUBSYSTEM);
+  }
   if (subsystem)
   {
+    OnlineSubsystemName = subsystem->GetSubsystemName();
     SessionInterface = subsystem->GetSessionInterface();
   }
+
+  FMultiplayerSessionsStartupTimeline::Record(TEXT("OnlineSubsystemResolved"), FPlatformTime::Seconds() - startTime);
+
+  BindSessionInterfaceDelegates();
+  return SessionInterface;
+}
+
+void UMultiplayerSessionsSubsystem::SetSessionInterfaceOverride(IOnlineSessionPtr sessionInterface)
+{
+  UnbindSessionInterfaceDelegates();
+  UnregisterFromMatchmaker();
+  ReleaseMatchmakerSlot();
+  ClearMatchmakerMatch();
+
+  // operations in flight belong to the previous backend
+  NamedSessions.Empty();
+  bFindSessionsPending = false;
+  bMatchmakerSearchPending = false;
+  LastSessionSearch.Reset();
+  ActiveGameSessionName = NAME_GameSession;
+  NextMatchNumPublicConnections = 0;
+  NextMatchType.Reset();
+  NextMatchTravelUrl.Reset();
+
+  SessionInterface = sessionInterface;
+  OnlineSubsystemName = NAME_None;
+  bSessionInterfaceResolved = SessionInterface.IsValid();
+  BindSessionInterfaceDelegates();
+}
+
+SIZE_T UMultiplayerSessionsSubsystem::GetDelegateAllocatedSize() const
+{
+  SIZE_T size = MultiplayerOnCreateSessionComplete.GetAllocatedSize() + MultiplayerOnFindSessionsComplete.GetAllocatedSize()
+    + MultiplayerOnJoinSessionComplete.GetAllocatedSize() + MultiplayerOnDestroySessionComplete.GetAllocatedSize()
+    + MultiplayerOnStartSessionComplete.GetAllocatedSize() + MultiplayerOnJoinQueued.GetAllocatedSize()
+    + NamedSessions.GetAllocatedSize();
+
+  for (const TPair<FName, FMultiplayerNamedSession>& namedSession : NamedSessions)
+  {
+    size += namedSession.Value.OnCreateSessionComplete.GetAllocatedSize() + namedSession.Value.OnJoinSessionComplete.GetAllocatedSize()
+      + namedSession.Value.OnDestroySessionComplete.GetAllocatedSize() + namedSession.Value.OnStartSessionComplete.GetAllocatedSize();
+  }
+  return size;
 }
 
-void UMultiplayerSessionsSubsystem::CreateSession(int32 numPublicConnections, FString matchType)
+int32 UMultiplayerSessionsSubsystem::GetNumMultiplayerDelegateBindings(const UObject* object) const
+{
+  int32 numBindings = 0;
+  for (const UObject* boundObject : MultiplayerOnCreateSessionComplete.GetAllObjects()) numBindings += boundObject == object ? 1 : 0;
+  for (const UObject* boundObject : MultiplayerOnDestroySessionComplete.GetAllObjects()) numBindings += boundObject == object ? 1 : 0;
+  for (const UObject* boundObject : MultiplayerOnStartSessionComplete.GetAllObjects()) numBindings += boundObject == object ? 1 : 0;
+
+  numBindings += MultiplayerOnFindSessionsComplete.IsBoundToObject(object) ? 1 : 0;
+  numBindings += MultiplayerOnJoinSessionComplete.IsBoundToObject(object) ? 1 : 0;
+  numBindings += MultiplayerOnJoinQueued.IsBoundToObject(object) ? 1 : 0;
+  return numBindings;
+}
+
+void UMultiplayerSessionsSubsystem::BindSessionInterfaceDelegates()
 {
   if (!SessionInterface.IsValid()) return;
 
-  // remove existing session if any
-  auto existingSession = SessionInterface->GetNamedSession(NAME_GameSession);
+  CreateSessionCompleteDelegateHandle = SessionInterface->AddOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegate);
+  FindSessionsCompleteDelegateHandle = SessionInterface->AddOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegate);
+  JoinSessionCompleteDelegateHandle = SessionInterface->AddOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegate);
+  DestroySessionCompleteDelegateHandle = SessionInterface->AddOnDestroySessionCompleteDelegate_Handle(DestroySessionCompleteDelegate);
+  StartSessionCompleteDelegateHandle = SessionInterface->AddOnStartSessionCompleteDelegate_Handle(StartSessionCompleteDelegate);
+  UpdateSessionCompleteDelegateHandle = SessionInterface->AddOnUpdateSessionCompleteDelegate_Handle(UpdateSessionCompleteDelegate);
+}
+
+void UMultiplayerSessionsSubsystem::UnbindSessionInterfaceDelegates()
+{
+  if (!SessionInterface.IsValid()) return;
+
+  SessionInterface->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegateHandle);
+  SessionInterface->ClearOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegateHandle);
+  SessionInterface->ClearOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegateHandle);
+  SessionInterface->ClearOnDestroySessionCompleteDelegate_Handle(DestroySessionCompleteDelegateHandle);
+  SessionInterface->ClearOnStartSessionCompleteDelegate_Handle(StartSessionCompleteDelegateHandle);
+  SessionInterface->ClearOnUpdateSessionCompleteDelegate_Handle(UpdateSessionCompleteDelegateHandle);
+}
+
+void UMultiplayerSessionsSubsystem::Deinitialize()
+{
+  UnbindSessionInterfaceDelegates();
+  UnregisterFromMatchmaker();
+  ReleaseMatchmakerSlot();
+  TravelProfiler.Deinitialize();
+  FWorldDelegates::OnWorldInitializedActors.Remove(WorldInitializedActorsHandle);
+  FWorldDelegates::OnWorldCleanup.Remove(WorldCleanupHandle);
+  RemoveActorSpawnedHandler();
+  if (GEngine)
+  {
+    GEngine->OnNetworkFailure().Remove(NetworkFailureHandle);
+  }
+  FTSTicker::GetCoreTicker().RemoveTicker(JoinQueueRetryHandle);
+
+  SessionInterface.Reset();
+  bSessionInterfaceResolved = false;
+  NamedSessions.Empty();
+
+  Super::Deinitialize();
+}
+
+void UMultiplayerSessionsSubsystem::CreateSession(int32 numPublicConnections, FString matchType, FName sessionName)
+{
+  if (!GetSessionInterface().IsValid()) return;
+
+  FMultiplayerNamedSession& namedSession = GetNamedSession(sessionName);
+
+  // remove existing session with the same name if any, the session is created again once it is destroyed
+  auto existingSession = SessionInterface->GetNamedSession(sessionName);
   if (existingSession != nullptr)
   {
-    bCreateSessionOnDestroy = true;
-    LastNumPublicConnections = numPublicConnections;
-    LastMatchType = matchType;
+    namedSession.bCreateSessionOnDestroy = true;
+    namedSession.LastNumPublicConnections = numPublicConnections;
+    namedSession.LastMatchType = matchType;
 
-    DestroySession();
+    DestroySession(sessionName);
+    return;
   }
 
   // session settings
-  LastSessionSettings = MakeShareable(new FOnlineSessionSettings());
-  LastSessionSettings->bIsLANMatch = IOnlineSubsystem::Get()->GetSubsystemName() == "NULL";
-  LastSessionSettings->NumPublicConnections = numPublicConnections;
-  LastSessionSettings->bAllowJoinInProgress = true;
-  LastSessionSettings->bAllowJoinViaPresence = true;
-  LastSessionSettings->bUsesPresence = true;
-  LastSessionSettings->bShouldAdvertise = true;
-  LastSessionSettings->bUseLobbiesIfAvailable = true;
-  LastSessionSettings->Set(FName("MatchType"), matchType, EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
-  LastSessionSettings->BuildUniqueId = 1;
+  namedSession.LastSessionSettings = MakeShareable(new FOnlineSessionSettings());
+  namedSession.LastSessionSettings->bIsLANMatch = OnlineSubsystemName == NULL_SUBSYSTEM;
+  namedSession.LastSessionSettings->NumPublicConnections = numPublicConnections;
+  namedSession.LastSessionSettings->bAllowJoinInProgress = true;
+  namedSession.LastSessionSettings->bAllowJoinViaPresence = true;
+  namedSession.LastSessionSettings->bUsesPresence = true;
+  namedSession.LastSessionSettings->bShouldAdvertise = true;
+  namedSession.LastSessionSettings->bUseLobbiesIfAvailable = true;
+  namedSession.LastSessionSettings->Set(FName("MatchType"), matchType, EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+  namedSession.LastSessionSettings->BuildUniqueId = 1;
 
   // create session
-  CreateSessionCompleteDelegateHandle = SessionInterface->AddOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegate);
+  namedSession.bCreatePending = true;
   const ULocalPlayer* localPlayer = GetWorld()->GetFirstLocalPlayerFromController();
-  if (!SessionInterface->CreateSession(*localPlayer->GetPreferredUniqueNetId(), NAME_GameSession, *LastSessionSettings))
+  if (!SessionInterface->CreateSession(*localPlayer->GetPreferredUniqueNetId(), sessionName, *namedSession.LastSessionSettings))
   {
-    SessionInterface->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegateHandle);
+    OnCreateSessionComplete(sessionName, false);
+  }
+}
+
+void UMultiplayerSessionsSubsystem::FindSessions(int32 maxSearchResults, const FString& matchType)
+{
+  if (!GetSessionInterface().IsValid()) return;
 
-    MultiplayerOnCreateSessionComplete.Broadcast(false);
+  // a new search gives up the session the matchmaker picked before
+  ReleaseMatchmakerSlot();
+  ClearMatchmakerMatch();
+
+  if (!GMatchmakerUrl.IsEmpty() && !matchType.IsEmpty())
+  {
+    FindSessionViaMatchmaker(maxSearchResults, matchType);
+    return;
   }
+  FindSessionsOnline(maxSearchResults);
 }
 
-void UMultiplayerSessionsSubsystem::FindSessions(int32 maxSearchResults)
+void UMultiplayerSessionsSubsystem::FindSessionsOnline(int32 maxSearchResults)
 {
-  if (!SessionInterface.IsValid()) return;
+  if (!GetSessionInterface().IsValid()) return;
 
-  FindSessionsCompleteDelegateHandle = SessionInterface->AddOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegate);
   LastSessionSearch = MakeShareable(new FOnlineSessionSearch());
   LastSessionSearch->MaxSearchResults = maxSearchResults;
-  LastSessionSearch->bIsLanQuery = IOnlineSubsystem::Get()->GetSubsystemName() == "NULL";
+  LastSessionSearch->bIsLanQuery = OnlineSubsystemName == NULL_SUBSYSTEM;
   LastSessionSearch->QuerySettings.Set(SEARCH_PRESENCE, true, EOnlineComparisonOp::Equals);
 
+  bFindSessionsPending = true;
   const ULocalPlayer* localPlayer = GetWorld()->GetFirstLocalPlayerFromController();
   if (!SessionInterface->FindSessions(*localPlayer->GetPreferredUniqueNetId(), LastSessionSearch.ToSharedRef()))
   {
-    SessionInterface->ClearOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegateHandle);
+    bFindSessionsPending = false;
 
     MultiplayerOnFindSessionsComplete.Broadcast(TArray<FOnlineSessionSearchResult>(), false);
   }
 }
 
-void UMultiplayerSessionsSubsystem::JoinSession(const FOnlineSessionSearchResult& sessionResult)
+void UMultiplayerSessionsSubsystem::FindSessionViaMatchmaker(int32 maxSearchResults, const FString& matchType)
 {
-  if (!SessionInterface.IsValid())
+  bMatchmakerSearchPending = true;
+  MatchmakerFallbackMaxSearchResults = maxSearchResults;
+
+  TSharedRef<IHttpRequest, ESPMode::ThreadSafe> request = FHttpModule::Get().CreateRequest();
+  request->SetURL(FString::Printf(TEXT("%s/match?region=%s&matchType=%s&players=1"),
+    *GMatchmakerUrl, *FGenericPlatformHttp::UrlEncode(GMatchmakerRegion), *FGenericPlatformHttp::UrlEncode(matchType)));
+  request->SetVerb(TEXT("GET"));
+  request->OnProcessRequestComplete().BindWeakLambda(this, [this](FHttpRequestPtr, FHttpResponsePtr response, bool bConnected)
+    {
+      if (!bMatchmakerSearchPending) return;
+
+      if (response.IsValid() && response->GetResponseCode() == EHttpResponseCodes::NotFound)
+      {
+        bMatchmakerSearchPending = false;
+        MultiplayerOnFindSessionsComplete.Broadcast(TArray<FOnlineSessionSearchResult>(), false);
+        return;
+      }
+
+      TSharedPtr<FJsonObject> json;
+      if (bConnected && response.IsValid() && EHttpResponseCodes::IsOk(response->GetResponseCode())
+        && FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(response->GetContentAsString()), json) && json.IsValid())
+      {
+        json->TryGetStringField(TEXT("sessionId"), MatchmakerMatchSessionId);
+        json->TryGetStringField(TEXT("address"), MatchmakerMatchAddress);
+      }
+
+      // the online subsystem resolves the id into a session that can be joined, where it cannot the host is joined by address
+      const FUniqueNetIdPtr sessionNetId = !MatchmakerMatchSessionId.IsEmpty() && SessionInterface.IsValid() ? SessionInterface->CreateSessionIdFromString(MatchmakerMatchSessionId) : nullptr;
+      const ULocalPlayer* localPlayer = GetWorld() ? GetWorld()->GetFirstLocalPlayerFromController() : nullptr;
+      const FUniqueNetIdPtr userId = localPlayer ? localPlayer->GetPreferredUniqueNetId().GetUniqueNetId() : nullptr;
+      if (sessionNetId.IsValid() && userId.IsValid()
+        && SessionInterface->FindSessionById(*userId, *sessionNetId, *userId, FOnSingleSessionResultCompleteDelegate::CreateUObject(this, &ThisClass::OnFindSessionByIdComplete)))
+      {
+        return;
+      }
+      if (!MatchmakerMatchAddress.IsEmpty())
+      {
+        bMatchmakerSearchPending = false;
+        JoinMatchByAddress();
+        return;
+      }
+
+      UE_LOG(LogMultiplayerSessions, Warning, TEXT("Matchmaker at %s gave no usable session, searching the online subsystem"), *GMatchmakerUrl);
+      bMatchmakerSearchPending = false;
+      FindSessionsOnline(MatchmakerFallbackMaxSearchResults);
+    });
+  request->ProcessRequest();
+}
+
+void UMultiplayerSessionsSubsystem::RegisterWithMatchmaker(FName sessionName)
+{
+  if (GMatchmakerUrl.IsEmpty()) return;
+
+  FTSTicker::GetCoreTicker().RemoveTicker(MatchmakerHeartbeatHandle);
+  MatchmakerSessionName = sessionName;
+  if (!SendMatchmakerHeartbeat()) return;
+
+  MatchmakerHeartbeatHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateWeakLambda(this, [this](float)
+    {
+      return SendMatchmakerHeartbeat();
+    }), GMatchmakerHeartbeatSeconds);
+}
+
+bool UMultiplayerSessionsSubsystem::SendMatchmakerHeartbeat()
+{
+  const FNamedOnlineSession* session = SessionInterface.IsValid() ? SessionInterface->GetNamedSession(MatchmakerSessionName) : nullptr;
+  if (!session || !session->SessionInfo.IsValid() || GMatchmakerUrl.IsEmpty())
   {
-    MultiplayerOnJoinSessionComplete.Broadcast(EOnJoinSessionCompleteResult::UnknownError);
-    return;
+    MatchmakerHeartbeatHandle.Reset();
+    return false;
   }
 
-  JoinSessionCompleteDelegateHandle = SessionInterface->AddOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegate);
+  MatchmakerSessionId = session->SessionInfo->GetSessionId().ToString();
+  FString matchType;
+  session->SessionSettings.Get(FName("MatchType"), matchType);
+  FString address;
+  SessionInterface->GetResolvedConnectString(MatchmakerSessionName, address);
+
+  TSharedRef<FJsonObject> json = MakeShared<FJsonObject>();
+  json->SetStringField(TEXT("sessionId"), MatchmakerSessionId);
+  json->SetStringField(TEXT("region"), GMatchmakerRegion);
+  json->SetStringField(TEXT("matchType"), matchType);
+  json->SetNumberField(TEXT("freeSlots"), session->NumOpenPublicConnections);
+  json->SetNumberField(TEXT("numPublicConnections"), session->SessionSettings.NumPublicConnections);
+  json->SetStringField(TEXT("address"), address);
+  PostToMatchmaker(TEXT("/sessions/register"), json);
+  return true;
+}
+
+void UMultiplayerSessionsSubsystem::UnregisterFromMatchmaker()
+{
+  FTSTicker::GetCoreTicker().RemoveTicker(MatchmakerHeartbeatHandle);
+  MatchmakerHeartbeatHandle.Reset();
+  MatchmakerSessionName = NAME_None;
+  if (MatchmakerSessionId.IsEmpty() || GMatchmakerUrl.IsEmpty()) return;
+
+  TSharedRef<FJsonObject> json = MakeShared<FJsonObject>();
+  json->SetStringField(TEXT("sessionId"), MatchmakerSessionId);
+  PostToMatchmaker(TEXT("/sessions/unregister"), json);
+  MatchmakerSessionId.Reset();
+}
+
+void UMultiplayerSessionsSubsystem::JoinMatchByAddress()
+{
+  // Steam and the NULL subsystem cannot look a session up by id, the client travels to the address the host registered
+  UE_LOG(LogMultiplayerSessions, Display, TEXT("Joining the matched session %s at %s"), *MatchmakerMatchSessionId, *MatchmakerMatchAddress);
+  CancelQueuedJoin();
+  bJoinedMatchByAddress = true;
+  ReserveMatchmakerSlot();
+  MultiplayerOnJoinSessionComplete.Broadcast(EOnJoinSessionCompleteResult::Success);
+}
+
+void UMultiplayerSessionsSubsystem::ReserveMatchmakerSlot()
+{
+  if (bMatchmakerSlotReserved || MatchmakerMatchSessionId.IsEmpty() || GMatchmakerUrl.IsEmpty()) return;
 
+  TSharedRef<FJsonObject> json = MakeShared<FJsonObject>();
+  json->SetStringField(TEXT("sessionId"), MatchmakerMatchSessionId);
+  json->SetNumberField(TEXT("players"), 1);
+  PostToMatchmaker(TEXT("/sessions/reserve"), json);
+  bMatchmakerSlotReserved = true;
+}
+
+void UMultiplayerSessionsSubsystem::ReleaseMatchmakerSlot()
+{
+  if (!bMatchmakerSlotReserved || GMatchmakerUrl.IsEmpty()) return;
+  bMatchmakerSlotReserved = false;
+
+  TSharedRef<FJsonObject> json = MakeShared<FJsonObject>();
+  json->SetStringField(TEXT("sessionId"), MatchmakerMatchSessionId);
+  json->SetNumberField(TEXT("players"), 1);
+  PostToMatchmaker(TEXT("/sessions/release"), json);
+}
+
+void UMultiplayerSessionsSubsystem::ClearMatchmakerMatch()
+{
+  MatchmakerMatchSessionId.Reset();
+  MatchmakerMatchAddress.Reset();
+  bJoinedMatchByAddress = false;
+  bMatchmakerSlotReserved = false;
+}
+
+void UMultiplayerSessionsSubsystem::JoinSession(const FOnlineSessionSearchResult& sessionResult, FName sessionName)
+{
+  CancelQueuedJoin();
+  bJoinedMatchByAddress = false;
+
+  FMultiplayerNamedSession& namedSession = GetNamedSession(sessionName);
+  if (!GetSessionInterface().IsValid())
+  {
+    namedSession.bJoinPending = true;
+    OnJoinSessionComplete(sessionName, EOnJoinSessionCompleteResult::UnknownError);
+    return;
+  }
+
+  namedSession.bJoinPending = true;
   const ULocalPlayer* localPlayer = GetWorld()->GetFirstLocalPlayerFromController();
-  if (!SessionInterface->JoinSession(*localPlayer->GetPreferredUniqueNetId(), NAME_GameSession, sessionResult))
+  if (!SessionInterface->JoinSession(*localPlayer->GetPreferredUniqueNetId(), sessionName, sessionResult))
+  {
+    OnJoinSessionComplete(sessionName, EOnJoinSessionCompleteResult::UnknownError);
+  }
+}
+
+void UMultiplayerSessionsSubsystem::DestroySession(FName sessionName)
+{
+  if (sessionName == MatchmakerSessionName)
+  {
+    UnregisterFromMatchmaker();
+  }
+
+  FMultiplayerNamedSession& namedSession = GetNamedSession(sessionName);
+  namedSession.bDestroyPending = true;
+  if (!GetSessionInterface().IsValid())
   {
-    SessionInterface->ClearOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegateHandle);
+    OnDestroySessionComplete(sessionName, false);
+    return;
+  }
+
+  if (!SessionInterface->DestroySession(sessionName))
+  {
+    OnDestroySessionComplete(sessionName, false);
+  }
+}
+
+void UMultiplayerSessionsSubsystem::StartSession(FName sessionName)
+{
+  if (!GetSessionInterface().IsValid()) return;
 
-    MultiplayerOnJoinSessionComplete.Broadcast(EOnJoinSessionCompleteResult::UnknownError);
+  FMultiplayerNamedSession& namedSession = GetNamedSession(sessionName);
+  namedSession.bStartPending = true;
+  if (!SessionInterface->StartSession(sessionName))
+  {
+    OnStartSessionComplete(sessionName, false);
   }
 }
 
-void UMultiplayerSessionsSubsystem::DestroySession()
+bool UMultiplayerSessionsSubsystem::TravelToPreJoinedSession(FName sessionName)
 {
-  if (!SessionInterface.IsValid())
+  if (!GetSessionInterface().IsValid()) return false;
+
+  FString address;
+  if (!SessionInterface->GetResolvedConnectString(sessionName, address)) return false;
+
+  APlayerController* playerController = GetGameInstance()->GetFirstLocalPlayerController();
+  if (!playerController) return false;
+
+  // the old match session is not needed for the travel, so do not wait for it to be destroyed
+  const FName previousSessionName = ActiveGameSessionName;
+  ActiveGameSessionName = sessionName;
+  if (previousSessionName != sessionName && SessionInterface->GetNamedSession(previousSessionName) != nullptr)
   {
-    MultiplayerOnDestroySessionComplete.Broadcast(false);
+    DestroySession(previousSessionName);
+  }
+
+  TravelProfiler.TravelIssued(false, address);
+  playerController->ClientTravel(address, ETravelType::TRAVEL_Absolute);
+  return true;
+}
+
+void UMultiplayerSessionsSubsystem::PrepareNextMatch(int32 numPublicConnections, FString matchType)
+{
+  NextMatchNumPublicConnections = FMath::Max(numPublicConnections, 1);
+  NextMatchType = matchType;
+}
+
+void UMultiplayerSessionsSubsystem::StartNextMatch(const FString& travelUrl)
+{
+  if (!GetSessionInterface().IsValid()) return;
+
+  TravelProfiler.BeginTravel(true);
+  NextMatchTravelUrl = travelUrl;
+
+  const int32 numPublicConnections = NextMatchNumPublicConnections;
+  const FString matchType = NextMatchType;
+  NextMatchNumPublicConnections = 0;
+  NextMatchType.Reset();
+
+  // nothing to carry on, the travel waits for the session to be created
+  FNamedOnlineSession* session = SessionInterface->GetNamedSession(ActiveGameSessionName);
+  if (!session)
+  {
+    if (numPublicConnections > 0)
+    {
+      CreateSession(numPublicConnections, matchType, ActiveGameSessionName);
+      return;
+    }
+    TravelToNextMatch();
     return;
   }
 
-  DestroySessionCompleteDelegateHandle = SessionInterface->AddOnDestroySessionCompleteDelegate_Handle(DestroySessionCompleteDelegate);
+  // the players of the running match travel along and keep their slots, the update is advertised in the background
+  if (numPublicConnections > 0)
+  {
+    FOnlineSessionSettings settings = session->SessionSettings;
+    const int32 filledConnections = FMath::Max(settings.NumPublicConnections - session->NumOpenPublicConnections, 0);
+    settings.NumPublicConnections = numPublicConnections;
+    settings.Set(FName("MatchType"), matchType, EOnlineDataAdvertisementType::ViaOnlineServiceAndPing);
+    if (SessionInterface->UpdateSession(ActiveGameSessionName, settings, true))
+    {
+      session->NumOpenPublicConnections = FMath::Max(numPublicConnections - filledConnections, 0);
+    }
+    else
+    {
+      UE_LOG(LogMultiplayerSessions, Warning, TEXT("Could not update %s for the next match, it keeps its settings"), *ActiveGameSessionName.ToString());
+    }
+  }
+  TravelToNextMatch();
+}
+
+void UMultiplayerSessionsSubsystem::TravelToNextMatch()
+{
+  UWorld* world = GetWorld();
+  if (NextMatchTravelUrl.IsEmpty() || !world)
+  {
+    TravelProfiler.CancelTravel(TEXT("the next match has no travel url"));
+    return;
+  }
+
+  TravelProfiler.TravelIssued(true, NextMatchTravelUrl);
+  world->ServerTravel(NextMatchTravelUrl);
+  NextMatchTravelUrl.Reset();
+}
+
+void UMultiplayerSessionsSubsystem::OnWorldInitializedActors(const FActorsInitializedParams& params)
+{
+  UWorld* world = params.World;
+  if (!world || world->GetGameInstance() != GetGameInstance()) return;
+
+  // the client made it into the host's world, a reserved slot is counted by the host from now on
+  if (world->GetNetMode() == NM_Client)
+  {
+    CancelQueuedJoin();
+    ClearMatchmakerMatch();
+  }
 
-  if (!SessionInterface->DestroySession(NAME_GameSession))
+  AGameModeBase* gameMode = world->GetAuthGameMode();
+  if (gameMode && gameMode->GameSession)
   {
-    SessionInterface->ClearOnDestroySessionCompleteDelegate_Handle(DestroySessionCompleteDelegateHandle);
-    MultiplayerOnDestroySessionComplete.Broadcast(false);
+    gameMode->GameSession->SessionName = ActiveGameSessionName;
   }
+
+  // before the local players are spawned, and on clients before the player states of the host arrive
+  RemoveActorSpawnedHandler();
+  ActorSpawnedWorld = world;
+  ActorSpawnedHandle = world->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &ThisClass::OnActorSpawned));
 }
 
-void UMultiplayerSessionsSubsystem::StartSession()
+void UMultiplayerSessionsSubsystem::OnActorSpawned(AActor* actor)
 {
+  // APlayerState::RegisterPlayerWithSession registers with the session named here, NAME_GameSession by default
+  if (APlayerState* playerState = Cast<APlayerState>(actor))
+  {
+    playerState->SessionName = ActiveGameSessionName;
+  }
 }
 
-void UMultiplayerSessionsSubsystem::OnCreateSessionComplete(FName sessionName, bool bWasSuccessful)
+void UMultiplayerSessionsSubsystem::OnWorldCleanup(UWorld* world, bool bSessionEnded, bool bCleanupResources)
 {
-  if (SessionInterface)
+  if (world && world == ActorSpawnedWorld.Get())
   {
-    SessionInterface->ClearOnCreateSessionCompleteDelegate_Handle(CreateSessionCompleteDelegateHandle);
+    RemoveActorSpawnedHandler();
   }
+}
 
-  MultiplayerOnCreateSessionComplete.Broadcast(bWasSuccessful);
+void UMultiplayerSessionsSubsystem::RemoveActorSpawnedHandler()
+{
+  if (UWorld* world = ActorSpawnedWorld.Get())
+  {
+    world->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+  }
+  ActorSpawnedWorld.Reset();
+  ActorSpawnedHandle.Reset();
 }
 
-void UMultiplayerSessionsSubsystem::OnFindSessionsComplete(bool bWasSuccessful)
+FMultiplayerNamedSession& UMultiplayerSessionsSubsystem::GetNamedSession(FName sessionName)
+{
+  return NamedSessions.FindOrAdd(sessionName);
+}
+
+bool UMultiplayerSessionsSubsystem::GetGameSessionConnectString(FString& outAddress)
+{
+  if (bJoinedMatchByAddress)
+  {
+    outAddress = MatchmakerMatchAddress;
+    return true;
+  }
+  return GetSessionInterface().IsValid() && SessionInterface->GetResolvedConnectString(ActiveGameSessionName, outAddress);
+}
+
+void UMultiplayerSessionsSubsystem::PruneNamedSession(FName sessionName)
+{
+  const FMultiplayerNamedSession* namedSession = NamedSessions.Find(sessionName);
+  if (!namedSession || namedSession->bCreatePending || namedSession->bJoinPending || namedSession->bDestroyPending || namedSession->bStartPending
+    || namedSession->bCreateSessionOnDestroy) return;
+
+  // bound delegates, e.g. of the soak test, stay bound for the next session of that name
+  if (namedSession->OnCreateSessionComplete.IsBound() || namedSession->OnJoinSessionComplete.IsBound()
+    || namedSession->OnDestroySessionComplete.IsBound() || namedSession->OnStartSessionComplete.IsBound()) return;
+
+  if (SessionInterface.IsValid() && SessionInterface->GetNamedSession(sessionName) != nullptr) return;
+
+  NamedSessions.Remove(sessionName);
+}
+
+void UMultiplayerSessionsSubsystem::OnCreateSessionComplete(FName sessionName, bool bWasSuccessful)
 {
-  if (SessionInterface)
+  // sessions created outside of this subsystem are not ours to report
+  FMultiplayerNamedSession* namedSession = NamedSessions.Find(sessionName);
+  if (!namedSession || !namedSession->bCreatePending) return;
+  namedSession->bCreatePending = false;
+
+  if (bWasSuccessful && sessionName == ActiveGameSessionName)
+  {
+    RegisterWithMatchmaker(sessionName);
+  }
+
+  namedSession->OnCreateSessionComplete.Broadcast(sessionName, bWasSuccessful);
+  if (sessionName == ActiveGameSessionName)
+  {
+    MultiplayerOnCreateSessionComplete.Broadcast(bWasSuccessful);
+  }
+  if (!bWasSuccessful)
   {
-    SessionInterface->ClearOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegateHandle);
+    PruneNamedSession(sessionName);
   }
 
+  // StartNextMatch without a game session waits for it to be created
+  if (NextMatchTravelUrl.IsEmpty()) return;
+  if (sessionName == ActiveGameSessionName)
+  {
+    if (bWasSuccessful)
+    {
+      TravelToNextMatch();
+    }
+    else
+    {
+      NextMatchTravelUrl.Reset();
+      TravelProfiler.CancelTravel(TEXT("the session of the next match could not be created"));
+    }
+  }
+}
+
+void UMultiplayerSessionsSubsystem::OnFindSessionsComplete(bool bWasSuccessful)
+{
+  if (!bFindSessionsPending) return;
+  bFindSessionsPending = false;
+
   if (LastSessionSearch->SearchResults.Num() <= 0)
   {
     MultiplayerOnFindSessionsComplete.Broadcast(TArray<FOnlineSessionSearchResult>(), false);
@@ -143,31 +717,162 @@ void UMultiplayerSessionsSubsystem::OnFindSessionsComplete(bool bWasSuccessful)
   MultiplayerOnFindSessionsComplete.Broadcast(LastSessionSearch->SearchResults, bWasSuccessful);
 }
 
+void UMultiplayerSessionsSubsystem::OnFindSessionByIdComplete(int32 localUserNum, bool bWasSuccessful, const FOnlineSessionSearchResult& searchResult)
+{
+  if (!bMatchmakerSearchPending) return;
+  bMatchmakerSearchPending = false;
+
+  // the online subsystem cannot look sessions up by id, or the session ended since its last heartbeat
+  if (!bWasSuccessful || !searchResult.IsValid())
+  {
+    if (!MatchmakerMatchAddress.IsEmpty())
+    {
+      JoinMatchByAddress();
+      return;
+    }
+    FindSessionsOnline(MatchmakerFallbackMaxSearchResults);
+    return;
+  }
+
+  TArray<FOnlineSessionSearchResult> sessionResults;
+  sessionResults.Add(searchResult);
+  MultiplayerOnFindSessionsComplete.Broadcast(sessionResults, true);
+}
+
 void UMultiplayerSessionsSubsystem::OnJoinSessionComplete(FName sessionName, EOnJoinSessionCompleteResult::Type result)
 {
-  if (SessionInterface)
+  FMultiplayerNamedSession* namedSession = NamedSessions.Find(sessionName);
+  if (!namedSession || !namedSession->bJoinPending) return;
+  namedSession->bJoinPending = false;
+
+  // the join of the session the matchmaker picked is confirmed, its slot is taken until the client made it in
+  const FNamedOnlineSession* session = result == EOnJoinSessionCompleteResult::Success && SessionInterface.IsValid() ? SessionInterface->GetNamedSession(sessionName) : nullptr;
+  if (session && session->SessionInfo.IsValid() && session->SessionInfo->GetSessionId().ToString() == MatchmakerMatchSessionId)
   {
-    SessionInterface->ClearOnJoinSessionCompleteDelegate_Handle(JoinSessionCompleteDelegateHandle);
+    ReserveMatchmakerSlot();
   }
 
-  MultiplayerOnJoinSessionComplete.Broadcast(result);
+  namedSession->OnJoinSessionComplete.Broadcast(sessionName, result);
+  if (sessionName == ActiveGameSessionName)
+  {
+    MultiplayerOnJoinSessionComplete.Broadcast(result);
+  }
+  if (result != EOnJoinSessionCompleteResult::Success && result != EOnJoinSessionCompleteResult::AlreadyInSession)
+  {
+    PruneNamedSession(sessionName);
+  }
 }
 
 void UMultiplayerSessionsSubsystem::OnDestroySessionComplete(FName sessionName, bool bWasSuccessful)
 {
-  if (SessionInterface)
+  FMultiplayerNamedSession* namedSession = NamedSessions.Find(sessionName);
+  if (!namedSession || !namedSession->bDestroyPending) return;
+  namedSession->bDestroyPending = false;
+
+  if (namedSession->bCreateSessionOnDestroy)
   {
-    SessionInterface->ClearOnDestroySessionCompleteDelegate_Handle(DestroySessionCompleteDelegateHandle);
+    namedSession->bCreateSessionOnDestroy = false;
+    if (bWasSuccessful)
+    {
+      CreateSession(namedSession->LastNumPublicConnections, namedSession->LastMatchType, sessionName);
+    }
+    else
+    {
+      // the queued create fails with the destroy, e.g. a next match waiting for it gives up its travel
+      namedSession->bCreatePending = true;
+      OnCreateSessionComplete(sessionName, false);
+    }
   }
-  if (bWasSuccessful && bCreateSessionOnDestroy)
+
+  // CreateSession may have grown the map, look the session up again
+  GetNamedSession(sessionName).OnDestroySessionComplete.Broadcast(sessionName, bWasSuccessful);
+  if (sessionName == ActiveGameSessionName)
   {
-    bCreateSessionOnDestroy = false;
-    CreateSession(LastNumPublicConnections, LastMatchType);
+    MultiplayerOnDestroySessionComplete.Broadcast(bWasSuccessful);
   }
-
-  MultiplayerOnDestroySessionComplete.Broadcast(bWasSuccessful);
+  PruneNamedSession(sessionName);
 }
 
 void UMultiplayerSessionsSubsystem::OnStartSessionComplete(FName sessionName, bool bWasSuccessful)
 {
+  FMultiplayerNamedSession* namedSession = NamedSessions.Find(sessionName);
+  if (!namedSession || !namedSession->bStartPending) return;
+  namedSession->bStartPending = false;
+
+  namedSession->OnStartSessionComplete.Broadcast(sessionName, bWasSuccessful);
+  if (sessionName == ActiveGameSessionName)
+  {
+    MultiplayerOnStartSessionComplete.Broadcast(bWasSuccessful);
+  }
+}
+
+void UMultiplayerSessionsSubsystem::OnUpdateSessionComplete(FName sessionName, bool bWasSuccessful)
+{
+  if (!bWasSuccessful)
+  {
+    UE_LOG(LogMultiplayerSessions, Warning, TEXT("The online subsystem did not update %s"), *sessionName.ToString());
+    return;
+  }
+
+  // the matchmaker learns the new match type and slots now rather than with the next heartbeat
+  if (sessionName == MatchmakerSessionName && MatchmakerHeartbeatHandle.IsValid())
+  {
+    SendMatchmakerHeartbeat();
+  }
+}
+
+void UMultiplayerSessionsSubsystem::OnNetworkFailure(UWorld* world, UNetDriver* netDriver, ENetworkFailure::Type failureType, const FString& errorString)
+{
+  // the pending connection has no world yet, find the game instance through its net driver
+  const FWorldContext* worldContext = world ? GEngine->GetWorldContextFromWorld(world) : GEngine->GetWorldContextFromPendingNetGameNetDriver(netDriver);
+  if (!worldContext || worldContext->OwningGameInstance != GetGameInstance()) return;
+
+  // the client did not make it into the matched session, the slot goes back to the matchmaker
+  if (failureType != ENetworkFailure::PendingConnectionFailure || !errorString.StartsWith(JoinQueuedErrorPrefix))
+  {
+    ReleaseMatchmakerSlot();
+    bJoinedMatchByAddress = false;
+    return;
+  }
+
+  // the URL that was connected to, clients that joined by address have no session to travel to
+  if (worldContext->PendingNetGame)
+  {
+    JoinQueueRetryUrl = worldContext->PendingNetGame->URL.ToString();
+  }
+  if (JoinQueueRetryUrl.IsEmpty()) return;
+
+  if (NumJoinQueueRetries >= JoinQueueMaxRetries)
+  {
+    UE_LOG(LogMultiplayerSessions, Warning, TEXT("Giving up the queued join of %s after %d retries"), *JoinQueueRetryUrl, NumJoinQueueRetries);
+    CancelQueuedJoin();
+    ReleaseMatchmakerSlot();
+    bJoinedMatchByAddress = false;
+    MultiplayerOnJoinQueued.Broadcast(INDEX_NONE);
+    return;
+  }
+  ++NumJoinQueueRetries;
+
+  const int32 queuePosition = FCString::Atoi(*errorString.RightChop(FCString::Strlen(JoinQueuedErrorPrefix)));
+  MultiplayerOnJoinQueued.Broadcast(queuePosition);
+
+  FTSTicker::GetCoreTicker().RemoveTicker(JoinQueueRetryHandle);
+  JoinQueueRetryHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateWeakLambda(this, [this](float)
+    {
+      JoinQueueRetryHandle.Reset();
+      if (APlayerController* playerController = GetGameInstance()->GetFirstLocalPlayerController())
+      {
+        TravelProfiler.TravelIssued(false, JoinQueueRetryUrl);
+        playerController->ClientTravel(JoinQueueRetryUrl, ETravelType::TRAVEL_Absolute);
+      }
+      return false;
+    }), JoinQueueRetrySeconds);
+}
+
+void UMultiplayerSessionsSubsystem::CancelQueuedJoin()
+{
+  FTSTicker::GetCoreTicker().RemoveTicker(JoinQueueRetryHandle);
+  JoinQueueRetryHandle.Reset();
+  JoinQueueRetryUrl.Reset();
+  NumJoinQueueRetries = 0;
 }
@@ -0,0 +1,273 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MultiplayerSessionsTravelProfiler.h"
+#include "MultiplayerSessionsReport.h"
+#include "Engine/Engine.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "ProfilingDebugging/MiscTrace.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogTravelProfiler, Log, All);
+
+static float GTravelHitchBudgetMs = 100.0f;
+static FAutoConsoleVariableRef CVarTravelHitchBudgetMs(
+  TEXT("MultiplayerSessions.TravelHitchBudgetMs"),
+  GTravelHitchBudgetMs,
+  TEXT("Frames of a travel into a session that take longer than this are flagged as hitches"));
+
+// A travel that did not reach the game by then is reported as not completed
+static float GTravelTimeoutSeconds = 60.0f;
+static FAutoConsoleVariableRef CVarTravelTimeoutSeconds(
+  TEXT("MultiplayerSessions.TravelTimeoutSeconds"),
+  GTravelTimeoutSeconds,
+  TEXT("Seconds after which a travel into a session that did not reach the game is reported as not completed"));
+
+const TCHAR* LexToString(EMultiplayerTravelPhase phase)
+{
+  switch (phase)
+  {
+  case EMultiplayerTravelPhase::SessionResolve: return TEXT("SessionResolve");
+  case EMultiplayerTravelPhase::Connect: return TEXT("Connect");
+  case EMultiplayerTravelPhase::MapLoad: return TEXT("MapLoad");
+  case EMultiplayerTravelPhase::ActorSpawn: return TEXT("ActorSpawn");
+  case EMultiplayerTravelPhase::FirstReplicatedFrame: return TEXT("FirstReplicatedFrame");
+  default: return TEXT("None");
+  }
+}
+
+static FString GetTraceRegionName(EMultiplayerTravelPhase phase)
+{
+  return FString::Printf(TEXT("Travel: %s"), LexToString(phase));
+}
+
+void FMultiplayerSessionsTravelProfiler::Initialize(UGameInstance* gameInstance)
+{
+  GameInstance = gameInstance;
+
+  PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddRaw(this, &FMultiplayerSessionsTravelProfiler::OnPreLoadMap);
+  PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddRaw(this, &FMultiplayerSessionsTravelProfiler::OnPostLoadMap);
+  if (GEngine)
+  {
+    TravelFailureHandle = GEngine->OnTravelFailure().AddRaw(this, &FMultiplayerSessionsTravelProfiler::OnTravelFailure);
+    NetworkFailureHandle = GEngine->OnNetworkFailure().AddRaw(this, &FMultiplayerSessionsTravelProfiler::OnNetworkFailure);
+  }
+}
+
+void FMultiplayerSessionsTravelProfiler::Deinitialize()
+{
+  if (IsTraveling())
+  {
+    FinishTravel(false, TEXT("the game instance shut down"));
+  }
+
+  FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+  FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+  if (GEngine)
+  {
+    GEngine->OnTravelFailure().Remove(TravelFailureHandle);
+    GEngine->OnNetworkFailure().Remove(NetworkFailureHandle);
+  }
+  GameInstance.Reset();
+}
+
+void FMultiplayerSessionsTravelProfiler::BeginTravel(bool bHost)
+{
+  if (IsTraveling())
+  {
+    FinishTravel(false, TEXT("a new travel began"));
+  }
+
+  bHostTravel = bHost;
+  TravelUrl.Reset();
+  LoadedMapName.Reset();
+  for (FPhaseTiming& timing : Phases)
+  {
+    timing = FPhaseTiming();
+  }
+
+  TravelStartSeconds = FPlatformTime::Seconds();
+  LastFrameSeconds = TravelStartSeconds;
+  EnterPhase(EMultiplayerTravelPhase::SessionResolve);
+  LastFramePhase = CurrentPhase;
+
+  TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FMultiplayerSessionsTravelProfiler::Tick));
+}
+
+void FMultiplayerSessionsTravelProfiler::TravelIssued(bool bHost, const FString& url)
+{
+  if (!IsTraveling() || CurrentPhase > EMultiplayerTravelPhase::SessionResolve)
+  {
+    BeginTravel(bHost);
+  }
+
+  TravelUrl = url;
+  EnterPhase(EMultiplayerTravelPhase::Connect);
+}
+
+void FMultiplayerSessionsTravelProfiler::CancelTravel(const FString& reason)
+{
+  if (IsTraveling())
+  {
+    FinishTravel(false, reason);
+  }
+}
+
+void FMultiplayerSessionsTravelProfiler::EnterPhase(EMultiplayerTravelPhase phase)
+{
+  const double now = FPlatformTime::Seconds();
+  if (IsTraveling())
+  {
+    Phases[static_cast<int32>(CurrentPhase)].EndSeconds = now;
+    TRACE_END_REGION(*GetTraceRegionName(CurrentPhase));
+  }
+
+  CurrentPhase = phase;
+  Phases[static_cast<int32>(phase)].StartSeconds = now;
+  TRACE_BEGIN_REGION(*GetTraceRegionName(phase));
+}
+
+bool FMultiplayerSessionsTravelProfiler::Tick(float deltaTime)
+{
+  // a frame counts towards the phase it started in, the blocking map load frame towards MapLoad
+  const double now = FPlatformTime::Seconds();
+  const double frameMs = (now - LastFrameSeconds) * 1000.0;
+  LastFrameSeconds = now;
+
+  FPhaseTiming& frameTiming = Phases[static_cast<int32>(LastFramePhase)];
+  ++frameTiming.NumFrames;
+  frameTiming.LongestFrameMs = FMath::Max(frameTiming.LongestFrameMs, frameMs);
+  if (frameMs > GTravelHitchBudgetMs)
+  {
+    ++frameTiming.NumHitches;
+    UE_LOG(LogTravelProfiler, Warning, TEXT("Travel hitch of %.1f ms during %s, budget %.1f ms"), frameMs, LexToString(LastFramePhase), GTravelHitchBudgetMs);
+  }
+
+  UGameInstance* gameInstance = GameInstance.Get();
+  UWorld* world = gameInstance ? gameInstance->GetWorld() : nullptr;
+  if (!world)
+  {
+    FinishTravel(false, TEXT("the game instance has no world"));
+    return false;
+  }
+
+  // the phases before ActorSpawn end in the map load delegates
+  if (CurrentPhase == EMultiplayerTravelPhase::ActorSpawn && world->HasBegunPlay())
+  {
+    EnterPhase(EMultiplayerTravelPhase::FirstReplicatedFrame);
+  }
+  if (CurrentPhase == EMultiplayerTravelPhase::FirstReplicatedFrame)
+  {
+    const APlayerController* playerController = gameInstance->GetFirstLocalPlayerController(world);
+    if (playerController && playerController->GetPawn())
+    {
+      FinishTravel(true, FString());
+      return false;
+    }
+  }
+
+  if (now - TravelStartSeconds > GTravelTimeoutSeconds)
+  {
+    FinishTravel(false, FString::Printf(TEXT("timed out during %s"), LexToString(CurrentPhase)));
+    return false;
+  }
+
+  LastFramePhase = CurrentPhase;
+  return true;
+}
+
+void FMultiplayerSessionsTravelProfiler::OnPreLoadMap(const FString& mapName)
+{
+  if (!IsTraveling() || CurrentPhase >= EMultiplayerTravelPhase::MapLoad) return;
+
+  LoadedMapName = mapName;
+  EnterPhase(EMultiplayerTravelPhase::MapLoad);
+}
+
+void FMultiplayerSessionsTravelProfiler::OnPostLoadMap(UWorld* world)
+{
+  if (!IsTraveling() || CurrentPhase != EMultiplayerTravelPhase::MapLoad) return;
+  if (world && world->GetGameInstance() != GameInstance.Get()) return;
+
+  EnterPhase(EMultiplayerTravelPhase::ActorSpawn);
+}
+
+void FMultiplayerSessionsTravelProfiler::OnTravelFailure(UWorld* world, ETravelFailure::Type failureType, const FString& errorString)
+{
+  if (!IsTraveling()) return;
+
+  const FWorldContext* worldContext = world ? GEngine->GetWorldContextFromWorld(world) : nullptr;
+  if (worldContext && worldContext->OwningGameInstance != GameInstance.Get()) return;
+
+  FinishTravel(false, FString::Printf(TEXT("%s: %s"), ETravelFailure::ToString(failureType), *errorString));
+}
+
+void FMultiplayerSessionsTravelProfiler::OnNetworkFailure(UWorld* world, UNetDriver* netDriver, ENetworkFailure::Type failureType, const FString& errorString)
+{
+  if (!IsTraveling()) return;
+
+  // the pending connection has no world yet, find the game instance through its net driver
+  const FWorldContext* worldContext = world ? GEngine->GetWorldContextFromWorld(world) : GEngine->GetWorldContextFromPendingNetGameNetDriver(netDriver);
+  if (!worldContext || worldContext->OwningGameInstance != GameInstance.Get()) return;
+
+  FinishTravel(false, FString::Printf(TEXT("%s: %s"), ENetworkFailure::ToString(failureType), *errorString));
+}
+
+void FMultiplayerSessionsTravelProfiler::FinishTravel(bool bCompleted, const FString& reason)
+{
+  const double now = FPlatformTime::Seconds();
+  Phases[static_cast<int32>(CurrentPhase)].EndSeconds = now;
+  TRACE_END_REGION(*GetTraceRegionName(CurrentPhase));
+
+  const EMultiplayerTravelPhase lastPhase = CurrentPhase;
+  CurrentPhase = EMultiplayerTravelPhase::Num;
+  FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+  TickerHandle.Reset();
+
+  FMultiplayerSessionsReport report(TEXT("Travel"));
+  report.Root->SetStringField(TEXT("role"), bHostTravel ? TEXT("host") : TEXT("client"));
+  report.Root->SetStringField(TEXT("url"), TravelUrl);
+  report.Root->SetStringField(TEXT("map"), LoadedMapName);
+  report.Root->SetBoolField(TEXT("completed"), bCompleted);
+  report.Root->SetStringField(TEXT("reason"), reason);
+  report.Root->SetNumberField(TEXT("totalMs"), (now - TravelStartSeconds) * 1000.0);
+  report.Root->SetNumberField(TEXT("hitchBudgetMs"), GTravelHitchBudgetMs);
+
+  int32 numHitches = 0;
+  FString summary;
+  for (int32 index = 0; index <= static_cast<int32>(lastPhase); ++index)
+  {
+    const FPhaseTiming& timing = Phases[index];
+    if (timing.StartSeconds <= 0.0) continue;
+
+    const EMultiplayerTravelPhase phase = static_cast<EMultiplayerTravelPhase>(index);
+    const double phaseMs = (timing.EndSeconds - timing.StartSeconds) * 1000.0;
+    numHitches += timing.NumHitches;
+    summary += FString::Printf(TEXT(" %s %.1f ms,"), LexToString(phase), phaseMs);
+
+    TSharedRef<FJsonObject> result = report.AddResult();
+    result->SetStringField(TEXT("phase"), LexToString(phase));
+    result->SetNumberField(TEXT("ms"), phaseMs);
+    result->SetNumberField(TEXT("frames"), timing.NumFrames);
+    result->SetNumberField(TEXT("longestFrameMs"), timing.LongestFrameMs);
+    result->SetNumberField(TEXT("hitches"), timing.NumHitches);
+  }
+  report.Root->SetNumberField(TEXT("hitches"), numHitches);
+  summary.RemoveFromEnd(TEXT(","));
+
+  if (bCompleted)
+  {
+    UE_LOG(LogTravelProfiler, Display, TEXT("%s travel took %.1f ms with %d hitches:%s"),
+      bHostTravel ? TEXT("Host") : TEXT("Client"), (now - TravelStartSeconds) * 1000.0, numHitches, *summary);
+  }
+  else
+  {
+    UE_LOG(LogTravelProfiler, Warning, TEXT("%s travel did not complete, %s:%s"), bHostTravel ? TEXT("Host") : TEXT("Client"), *reason, *summary);
+  }
+
+  report.Save();
+}
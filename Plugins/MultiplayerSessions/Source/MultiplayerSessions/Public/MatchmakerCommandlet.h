@@ -0,0 +1,22 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MatchmakerCommandlet.generated.h"
+
+/**
+ * Runs the matchmaker as its own process until it is asked to exit:
+ * UnrealEditor-Cmd.exe MyNetworkPlugin.uproject -run=Matchmaker [-Port=8090]
+ */
+UCLASS()
+class MULTIPLAYERSESSIONS_API UMatchmakerCommandlet : public UCommandlet
+{
+  GENERATED_BODY()
+
+public:
+  UMatchmakerCommandlet();
+
+  virtual int32 Main(const FString& Params) override;
+};
@@ -21,6 +21,8 @@ class MULTIPLAYERSESSIONS_API UMenu : public UUserWidget
 public:
   UFUNCTION(BlueprintCallable)
   void MenuSetup(int32 numOfPublicConnections = 4, FString matchType = FString(TEXT("FreeForAll")), FString lobbyPath = FString(TEXT("/Game/ThirdPerson/Maps/Lobby")));
+  // Unbinds from the subsystem and hands the input back to the game, called when the menu is destructed
+  void MenuTeardown();
 
 protected:
   virtual bool Initialize() override;
@@ -35,6 +37,7 @@ protected:
   void OnDestroySession(bool bWasSuccessful);
   UFUNCTION()
   void OnStartSession(bool bWasSuccessful);
+  void OnJoinQueued(int32 queuePosition);
 
 private:
   UFUNCTION()
@@ -42,7 +45,7 @@ private:
   UFUNCTION()
   void JoinButtonClicked();
 
-  void MenuTeardown();
+  void UnbindSubsystemDelegates();
 
 private:
   UPROPERTY(meta = (BindWidget))
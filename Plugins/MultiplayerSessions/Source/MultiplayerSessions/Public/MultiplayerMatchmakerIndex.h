@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * A session as hosts register it with the matchmaker
+ */
+struct FMatchmakerSession
+{
+  // Session id of the online subsystem, clients look the session up with FindSessionById
+  FString SessionId;
+  FString Region;
+  FString MatchType;
+  int32 FreeSlots = 0;
+  // Public connections of the session, free slots never go above it; 0 when the host did not report it
+  int32 NumPublicConnections = 0;
+  // Connect string of the host, for clients whose online subsystem cannot look the session up by id
+  FString Address;
+  double LastHeartbeatSeconds = 0.0;
+};
+
+/**
+ * Sessions of the matchmaker bucketed by region and match type, and within a bucket by free slots. A bucket keeps a
+ * bit per free slot count that has sessions, so the best match is found with one bit scan however many sessions
+ * are registered.
+ */
+class MULTIPLAYERSESSIONS_API FMultiplayerMatchmakerIndex
+{
+public:
+  // Sessions with more free slots are indexed as if they had this many
+  static constexpr int32 MaxIndexedFreeSlots = 64;
+
+  // Adds the session or replaces the registration with the same id, e.g. a heartbeat with new free slots
+  void Register(FMatchmakerSession session);
+  bool Unregister(const FString& sessionId);
+
+  // Takes numPlayers free slots of a session a client joins until the host reports its own count with the next
+  // heartbeat, so clients matching at the same time are spread over sessions instead of all getting the last free slot
+  bool ReserveSlots(const FString& sessionId, int32 numPlayers);
+  // Gives back the slots of a client that did not make it into the session, up to the public connections of the
+  // session as a heartbeat may already have counted them as free
+  bool ReleaseSlots(const FString& sessionId, int32 numPlayers);
+
+  // The session with the fewest free slots that still has room for numPlayers, so sessions fill up before
+  // the next one is started. Null when no session of the region and match type has room.
+  const FMatchmakerSession* FindBestMatch(const FString& region, const FString& matchType, int32 numPlayers) const;
+
+  // Removes the sessions whose last heartbeat is older than oldestHeartbeatSeconds, returns how many were removed
+  int32 RemoveExpired(double oldestHeartbeatSeconds);
+
+  int32 Num() const { return SessionIndices.Num(); }
+  SIZE_T GetAllocatedSize() const;
+
+private:
+  struct FEntry
+  {
+    FMatchmakerSession Session;
+    int32 BucketIndex = INDEX_NONE;
+    // Position in the free slot list of the bucket, INDEX_NONE while the session is full
+    int32 SlotListPosition = INDEX_NONE;
+  };
+
+  struct FBucket
+  {
+    // Entries by free slots, list 0 holds the sessions with 1 free slot
+    TArray<int32> EntriesByFreeSlots[MaxIndexedFreeSlots];
+    // Bit n is set when EntriesByFreeSlots[n] is not empty
+    uint64 NonEmptySlotLists = 0;
+  };
+
+  static FString GetBucketKey(const FString& region, const FString& matchType);
+  static int32 GetSlotList(int32 freeSlots) { return FMath::Min(freeSlots, MaxIndexedFreeSlots) - 1; }
+  static int32 ClampFreeSlots(const FMatchmakerSession& session, int32 freeSlots);
+
+  void AddToBucket(int32 entryIndex);
+  void RemoveFromBucket(int32 entryIndex);
+
+private:
+  TSparseArray<FEntry> Entries;
+  TMap<FString, int32> SessionIndices;
+  TArray<FBucket> Buckets;
+  TMap<FString, int32> BucketIndices;
+};
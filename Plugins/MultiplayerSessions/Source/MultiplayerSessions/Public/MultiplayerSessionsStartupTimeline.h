@@ -0,0 +1,19 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Cold start milestones, in seconds since the process started: module load, engine init, sessions subsystem init,
+ * online subsystem resolution and the first menu being ready. The timeline is logged once the first menu is ready
+ * and can be printed again with MultiplayerSessions.StartupTimeline. Every milestone is also an Insights bookmark.
+ */
+struct MULTIPLAYERSESSIONS_API FMultiplayerSessionsStartupTimeline
+{
+  // Only the first occurrence of a milestone is kept, durationSeconds is the time the step itself took if known
+  static void Record(FName milestone, double durationSeconds = 0.0);
+  static bool HasRecorded(FName milestone);
+
+  static void Dump();
+};
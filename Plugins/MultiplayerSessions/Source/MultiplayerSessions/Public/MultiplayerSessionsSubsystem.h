@@ -5,14 +5,47 @@
 #include "CoreMinimal.h"
 #include "Subsystems/GameInstanceSubsystem.h"
 #include "Interfaces/OnlineSessionInterface.h"
+#include "Containers/Ticker.h"
+#include "Engine/EngineBaseTypes.h"
+#include "MultiplayerSessionsTravelProfiler.h"
 #include "MultiplayerSessionsSubsystem.generated.h"
 
+struct FActorsInitializedParams;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMultiplayerOnCreateSessionComplete, bool, bWasSuccessful);
 DECLARE_MULTICAST_DELEGATE_TwoParams(FMultiplayerOnFindSessionsComplete, const TArray<FOnlineSessionSearchResult>& SessionResults, bool bWasSuccessful);
 DECLARE_MULTICAST_DELEGATE_OneParam(FMultiplayerOnJoinSessionComplete, EOnJoinSessionCompleteResult::Type Result);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMultiplayerOnDestroySessionComplete, bool, bWasSuccessful);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMultiplayerOnStartSessionComplete, bool, bWasSuccessful);
 
+DECLARE_MULTICAST_DELEGATE_OneParam(FMultiplayerOnJoinQueued, int32 QueuePosition);
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FMultiplayerOnNamedSessionComplete, FName SessionName, bool bWasSuccessful);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FMultiplayerOnNamedJoinSessionComplete, FName SessionName, EOnJoinSessionCompleteResult::Type Result);
+
+/**
+ * Completion delegates and bookkeeping of a single named session (NAME_GameSession, NAME_PartySession, a pre-joined match...)
+ */
+struct FMultiplayerNamedSession
+{
+  FMultiplayerOnNamedSessionComplete OnCreateSessionComplete;
+  FMultiplayerOnNamedJoinSessionComplete OnJoinSessionComplete;
+  FMultiplayerOnNamedSessionComplete OnDestroySessionComplete;
+  FMultiplayerOnNamedSessionComplete OnStartSessionComplete;
+
+  TSharedPtr<FOnlineSessionSettings> LastSessionSettings = nullptr;
+
+  // Operations issued by this subsystem that still wait for the online subsystem callback
+  bool bCreatePending = false;
+  bool bJoinPending = false;
+  bool bDestroyPending = false;
+  bool bStartPending = false;
+
+  bool bCreateSessionOnDestroy = false;
+  int32 LastNumPublicConnections = 0;
+  FString LastMatchType;
+};
+
 /**
  *
  */
@@ -24,11 +57,63 @@ class MULTIPLAYERSESSIONS_API UMultiplayerSessionsSubsystem : public UGameInstan
 public:
   UMultiplayerSessionsSubsystem();
 
-  void CreateSession(int32 numPublicConnections, FString matchType);
-  void FindSessions(int32 maxSearchResults);
-  void JoinSession(const FOnlineSessionSearchResult& sessionResult);
-  void DestroySession();
-  void StartSession();
+  // Start of the login error of a host that queued the join, followed by the queue position
+  static constexpr const TCHAR* JoinQueuedErrorPrefix = TEXT("Queued: position ");
+
+  virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+  virtual void Deinitialize() override;
+
+  // Every operation works on its own session name so e.g. a party session can stay alive next to the match session
+  void CreateSession(int32 numPublicConnections, FString matchType, FName sessionName = NAME_GameSession);
+  // With MultiplayerSessions.MatchmakerUrl set and a match type given the matchmaker picks the session and only that one
+  // is looked up, otherwise, or when the matchmaker cannot be reached, the online subsystem searches for all sessions.
+  // When the online subsystem cannot look the picked session up, the search completes with
+  // MultiplayerOnJoinSessionComplete right away and GetGameSessionConnectString returns the address of its host.
+  void FindSessions(int32 maxSearchResults, const FString& matchType = FString());
+  void JoinSession(const FOnlineSessionSearchResult& sessionResult, FName sessionName = NAME_GameSession);
+  void DestroySession(FName sessionName = NAME_GameSession);
+  void StartSession(FName sessionName = NAME_GameSession);
+
+  // Stops retrying a join the host queued
+  void CancelQueuedJoin();
+
+  // Travels to a session that was joined ahead of time under sessionName and makes it the active game session.
+  // The previous game session is destroyed in the background instead of before the travel.
+  bool TravelToPreJoinedSession(FName sessionName);
+
+  // Settings of the next match, set while the current one is still running. Online subsystems like Steam allow one
+  // presence session per user, so the game session carries on into the next match instead of a second one.
+  void PrepareNextMatch(int32 numPublicConnections, FString matchType);
+  bool HasPreparedNextMatch() const { return NextMatchNumPublicConnections > 0; }
+
+  // Ends the current match: the game session is updated to the prepared settings and the host travels to travelUrl
+  // right away, without waiting for the update. Without a game session one is created and then traveled to.
+  void StartNextMatch(const FString& travelUrl);
+
+  // Per session delegates, they fire for every session name unlike the Multiplayer* delegates below. The bookkeeping
+  // of a session nobody listens to is dropped once the session is destroyed or could not be created or joined.
+  FMultiplayerNamedSession& GetNamedSession(FName sessionName);
+  FName GetActiveGameSessionName() const { return ActiveGameSessionName; }
+
+  // Connect string of the active game session, or of the host of the matched session joined by address, where a
+  // client travels once it joined
+  bool GetGameSessionConnectString(FString& outAddress);
+
+  // Resolved on first use and cached, falls back to the NULL online subsystem when the default one is not available
+  IOnlineSessionPtr GetSessionInterface();
+
+  // Sessions go through sessionInterface instead of the online subsystem, e.g. the in-memory backend of the soak test.
+  // Drops the bookkeeping of all sessions, an invalid interface resolves the online subsystem again on next use.
+  void SetSessionInterfaceOverride(IOnlineSessionPtr sessionInterface);
+
+  // Memory held by the delegates bound to this subsystem and by its per session bookkeeping
+  SIZE_T GetDelegateAllocatedSize() const;
+  // Bindings of object to the Multiplayer* delegates, a native delegate counts once however often it is bound
+  int32 GetNumMultiplayerDelegateBindings(const UObject* object) const;
+  int32 GetNumNamedSessions() const { return NamedSessions.Num(); }
+
+  // Times the travels into sessions of this game instance, callers that travel report the steps they take
+  FMultiplayerSessionsTravelProfiler& GetTravelProfiler() { return TravelProfiler; }
 
 protected:
   void OnCreateSessionComplete(FName sessionName, bool bWasSuccessful);
@@ -36,21 +121,98 @@ protected:
   void OnJoinSessionComplete(FName sessionName, EOnJoinSessionCompleteResult::Type result);
   void OnDestroySessionComplete(FName sessionName, bool bWasSuccessful);
   void OnStartSessionComplete(FName sessionName, bool bWasSuccessful);
+  void OnUpdateSessionComplete(FName sessionName, bool bWasSuccessful);
+  void OnFindSessionByIdComplete(int32 localUserNum, bool bWasSuccessful, const FOnlineSessionSearchResult& searchResult);
+
+  void FindSessionsOnline(int32 maxSearchResults);
+  void FindSessionViaMatchmaker(int32 maxSearchResults, const FString& matchType);
+
+  // Hosts keep their game session registered with the matchmaker with a heartbeat while it exists
+  void RegisterWithMatchmaker(FName sessionName);
+  bool SendMatchmakerHeartbeat();
+  void UnregisterFromMatchmaker();
+
+  // Clients take a slot of the matched session once they join it and give it back when they do not make it in;
+  // the host's next heartbeat reports the real count either way
+  void JoinMatchByAddress();
+  void ReserveMatchmakerSlot();
+  void ReleaseMatchmakerSlot();
+  void ClearMatchmakerMatch();
+
+  // Online subsystem delegates are registered once per session interface
+  void BindSessionInterfaceDelegates();
+  void UnbindSessionInterfaceDelegates();
+
+  // Removes the bookkeeping of a session that no longer exists, has no operation pending and no delegate bound
+  void PruneNamedSession(FName sessionName);
+
+  void TravelToNextMatch();
+
+  // Points the game session and the player states of a new world at the active game session. Players register with
+  // the session their player state names, the host's own player is spawned before the map finished loading.
+  void OnWorldInitializedActors(const FActorsInitializedParams& params);
+  void OnActorSpawned(AActor* actor);
+  void OnWorldCleanup(UWorld* world, bool bSessionEnded, bool bCleanupResources);
+  void RemoveActorSpawnedHandler();
+
+  // Retries the travel to the URL the host queued the join of, with or without a session
+  void OnNetworkFailure(UWorld* world, UNetDriver* netDriver, ENetworkFailure::Type failureType, const FString& errorString);
 
 public:
-  // Delegates for callbacks for session creation info
+  // Delegates for callbacks for session creation info, only broadcast for the active game session
   FMultiplayerOnCreateSessionComplete MultiplayerOnCreateSessionComplete;
   FMultiplayerOnFindSessionsComplete MultiplayerOnFindSessionsComplete;
   FMultiplayerOnJoinSessionComplete MultiplayerOnJoinSessionComplete;
   FMultiplayerOnDestroySessionComplete MultiplayerOnDestroySessionComplete;
   FMultiplayerOnStartSessionComplete MultiplayerOnStartSessionComplete;
+  // Queue position of a join the host queued, INDEX_NONE when the retries were given up
+  FMultiplayerOnJoinQueued MultiplayerOnJoinQueued;
+
+  // Seconds between the retries of a queued join, the host drops the place after its QueueEntryTimeoutSeconds
+  float JoinQueueRetrySeconds = 3.0f;
+  // Retries of a queued join before it is given up
+  int32 JoinQueueMaxRetries = 20;
 
 
 private:
   IOnlineSessionPtr SessionInterface = nullptr;
-  TSharedPtr<FOnlineSessionSettings> LastSessionSettings = nullptr;
+  FName OnlineSubsystemName;
+  bool bSessionInterfaceResolved = false;
   TSharedPtr<FOnlineSessionSearch> LastSessionSearch = nullptr;
-
+  bool bFindSessionsPending = false;
+  bool bMatchmakerSearchPending = false;
+  int32 MatchmakerFallbackMaxSearchResults = 0;
+
+  FName MatchmakerSessionName = NAME_None;
+  FString MatchmakerSessionId;
+  FTSTicker::FDelegateHandle MatchmakerHeartbeatHandle;
+
+  // Session the matchmaker picked for this client and the address its host registered
+  FString MatchmakerMatchSessionId;
+  FString MatchmakerMatchAddress;
+  bool bJoinedMatchByAddress = false;
+  bool bMatchmakerSlotReserved = false;
+
+  TMap<FName, FMultiplayerNamedSession> NamedSessions;
+  FName ActiveGameSessionName = NAME_GameSession;
+
+  FDelegateHandle NetworkFailureHandle;
+  FTSTicker::FDelegateHandle JoinQueueRetryHandle;
+  FString JoinQueueRetryUrl;
+  int32 NumJoinQueueRetries = 0;
+  FDelegateHandle WorldInitializedActorsHandle;
+  FDelegateHandle WorldCleanupHandle;
+  // The world of this game instance the player state names are set in
+  TWeakObjectPtr<UWorld> ActorSpawnedWorld;
+  FDelegateHandle ActorSpawnedHandle;
+
+  int32 NextMatchNumPublicConnections = 0;
+  FString NextMatchType;
+  FString NextMatchTravelUrl;
+
+  FMultiplayerSessionsTravelProfiler TravelProfiler;
+
+  // Online subsystem delegates are registered once and dispatched by session name
   FOnCreateSessionCompleteDelegate CreateSessionCompleteDelegate;
   FDelegateHandle CreateSessionCompleteDelegateHandle;
 
@@ -66,7 +228,6 @@ private:
   FOnStartSessionCompleteDelegate StartSessionCompleteDelegate;
   FDelegateHandle StartSessionCompleteDelegateHandle;
 
-  bool bCreateSessionOnDestroy = false;
-  int32 LastNumPublicConnections;
-  FString LastMatchType;
+  FOnUpdateSessionCompleteDelegate UpdateSessionCompleteDelegate;
+  FDelegateHandle UpdateSessionCompleteDelegateHandle;
 };
@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Engine/EngineBaseTypes.h"
+
+class UGameInstance;
+class UNetDriver;
+class UWorld;
+
+/**
+ * Phases of a travel into a session, each one ends when the next one begins:
+ * SessionResolve from the host or join request until the travel is issued, Connect until the map starts loading
+ * (the handshake with the host on a client, the wait for the travel to be processed on the host), MapLoad until the
+ * map is loaded, ActorSpawn until the world has begun play and FirstReplicatedFrame until the local player controls a
+ * pawn, i.e. the host spawned it or a client received it.
+ */
+enum class EMultiplayerTravelPhase : uint8
+{
+  SessionResolve,
+  Connect,
+  MapLoad,
+  ActorSpawn,
+  FirstReplicatedFrame,
+  Num
+};
+
+MULTIPLAYERSESSIONS_API const TCHAR* LexToString(EMultiplayerTravelPhase phase);
+
+/**
+ * Times the phases of a ServerTravel or ClientTravel into a session. Every phase is an Insights region, frames longer
+ * than MultiplayerSessions.TravelHitchBudgetMs are flagged as hitches and every travel is written to
+ * Saved/Benchmarks/Travel-*.json.
+ */
+class MULTIPLAYERSESSIONS_API FMultiplayerSessionsTravelProfiler
+{
+public:
+  void Initialize(UGameInstance* gameInstance);
+  void Deinitialize();
+
+  // Starts a new travel in the session resolve phase, a travel still in progress is reported as not completed
+  void BeginTravel(bool bHost);
+  // The ServerTravel or ClientTravel was issued, starts a travel if none was begun
+  void TravelIssued(bool bHost, const FString& url);
+  // Ends the travel without reaching the game, e.g. the session could not be created or joined
+  void CancelTravel(const FString& reason);
+
+  bool IsTraveling() const { return CurrentPhase != EMultiplayerTravelPhase::Num; }
+
+private:
+  struct FPhaseTiming
+  {
+    double StartSeconds = 0.0;
+    double EndSeconds = 0.0;
+    double LongestFrameMs = 0.0;
+    int32 NumFrames = 0;
+    int32 NumHitches = 0;
+  };
+
+  void EnterPhase(EMultiplayerTravelPhase phase);
+  void FinishTravel(bool bCompleted, const FString& reason);
+  bool Tick(float deltaTime);
+
+  void OnPreLoadMap(const FString& mapName);
+  void OnPostLoadMap(UWorld* world);
+  void OnTravelFailure(UWorld* world, ETravelFailure::Type failureType, const FString& errorString);
+  void OnNetworkFailure(UWorld* world, UNetDriver* netDriver, ENetworkFailure::Type failureType, const FString& errorString);
+
+private:
+  TWeakObjectPtr<UGameInstance> GameInstance;
+
+  EMultiplayerTravelPhase CurrentPhase = EMultiplayerTravelPhase::Num;
+  EMultiplayerTravelPhase LastFramePhase = EMultiplayerTravelPhase::Num;
+  FPhaseTiming Phases[static_cast<int32>(EMultiplayerTravelPhase::Num)];
+  bool bHostTravel = false;
+  FString TravelUrl;
+  FString LoadedMapName;
+  double TravelStartSeconds = 0.0;
+  double LastFrameSeconds = 0.0;
+
+  FTSTicker::FDelegateHandle TickerHandle;
+  FDelegateHandle PreLoadMapHandle;
+  FDelegateHandle PostLoadMapHandle;
+  FDelegateHandle TravelFailureHandle;
+  FDelegateHandle NetworkFailureHandle;
+};
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CompressedReplayStreaming.h"
+#include "Misc/Compression.h"
+#include "Modules/ModuleManager.h"
+
+bool FCompressedLocalFileReplayStreamer::CompressBuffer(const TArray<uint8>& InBuffer, FArchive& OutCompressed) const
+{
+  int32 uncompressedSize = InBuffer.Num();
+  int32 compressedSize = FCompression::CompressMemoryBound(NAME_Oodle, uncompressedSize);
+
+  TArray<uint8> compressed;
+  compressed.SetNumUninitialized(compressedSize);
+  if (!FCompression::CompressMemory(NAME_Oodle, compressed.GetData(), compressedSize, InBuffer.GetData(), uncompressedSize))
+  {
+    return false;
+  }
+
+  OutCompressed << uncompressedSize;
+  OutCompressed << compressedSize;
+  OutCompressed.Serialize(compressed.GetData(), compressedSize);
+  return !OutCompressed.IsError();
+}
+
+bool FCompressedLocalFileReplayStreamer::DecompressBuffer(FArchive& InCompressed, TArray<uint8>& OutBuffer) const
+{
+  int32 uncompressedSize = 0;
+  int32 compressedSize = 0;
+  InCompressed << uncompressedSize;
+  InCompressed << compressedSize;
+  if (InCompressed.IsError() || uncompressedSize < 0 || compressedSize < 0 || compressedSize > InCompressed.TotalSize() - InCompressed.Tell())
+  {
+    return false;
+  }
+
+  TArray<uint8> compressed;
+  compressed.SetNumUninitialized(compressedSize);
+  InCompressed.Serialize(compressed.GetData(), compressedSize);
+
+  OutBuffer.SetNumUninitialized(uncompressedSize);
+  return FCompression::UncompressMemory(NAME_Oodle, OutBuffer.GetData(), uncompressedSize, compressed.GetData(), compressedSize);
+}
+
+TSharedPtr<INetworkReplayStreamer> FCompressedReplayStreamingFactory::CreateReplayStreamer()
+{
+  // registered like the base factory does so the streamer gets ticked and flushed
+  TSharedPtr<FCompressedLocalFileReplayStreamer> streamer = MakeShared<FCompressedLocalFileReplayStreamer>();
+  LocalFileStreamers.Add(streamer);
+  return streamer;
+}
+
+IMPLEMENT_MODULE(FCompressedReplayStreamingFactory, CompressedReplayStreaming)
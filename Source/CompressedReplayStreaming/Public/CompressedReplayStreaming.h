@@ -0,0 +1,28 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LocalFileNetworkReplayStreaming.h"
+
+/**
+ * Local file replay streamer that compresses the stream, checkpoint and event chunks with Oodle.
+ * Chunks are compressed and written by the tasks of the local file streamer, off the game thread, and
+ * playback still reads one chunk at a time so scrubbing never loads the whole file.
+ */
+class COMPRESSEDREPLAYSTREAMING_API FCompressedLocalFileReplayStreamer : public FLocalFileNetworkReplayStreamer
+{
+protected:
+	virtual bool SupportsCompression() const override { return true; }
+	virtual bool CompressBuffer(const TArray<uint8>& InBuffer, FArchive& OutCompressed) const override;
+	virtual bool DecompressBuffer(FArchive& InCompressed, TArray<uint8>& OutBuffer) const override;
+};
+
+/**
+ * Use with the ReplayStreamerOverride=CompressedReplayStreaming replay option
+ */
+class COMPRESSEDREPLAYSTREAMING_API FCompressedReplayStreamingFactory : public FLocalFileNetworkReplayStreamingFactory
+{
+public:
+	virtual TSharedPtr<INetworkReplayStreamer> CreateReplayStreamer() override;
+};
@@ -10,6 +10,6 @@ public class MyNetworkPluginTarget : TargetRules
 		Type = TargetType.Game;
 		DefaultBuildSettings = BuildSettingsVersion.V5;
 		IncludeOrderVersion = EngineIncludeOrderVersion.Unreal5_4;
-		ExtraModuleNames.Add("MyNetworkPlugin");
+		ExtraModuleNames.AddRange(new string[] { "MyNetworkPlugin", "CompressedReplayStreaming" });
 	}
 }
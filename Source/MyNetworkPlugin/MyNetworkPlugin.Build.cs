@@ -9,6 +9,8 @@ public class MyNetworkPlugin : ModuleRules
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput"
-		, "OnlineSubsystemSteam", "OnlineSubsystem"});
+		, "OnlineSubsystem", "Json", "MultiplayerSessions"});
+
+		PrivateDependencyModuleNames.AddRange(new string[] { "OodleNetworkHandlerComponent" });
 	}
 }
@@ -15,13 +15,113 @@
 #include "OnlineSubsystem.h"
 #include "OnlineSessionSettings.h"
 #include "Online/OnlineSessionNames.h"
+#include "MyNetworkPluginCharacterMovementComponent.h"
+#include "LagCompensationSubsystem.h"
+#include "Net/UnrealNetwork.h"
+#include "MyNetworkPluginCharacterMeshComponent.h"
+#include "NetBenchmarkSubsystem.h"
+#include "MultiplayerSessionsSubsystem.h"
+#include "Engine/GameInstance.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
 
 DEFINE_LOG_CATEGORY(LogTemplateCharacter);
 
+static void OnCharacterReduceCostChanged(IConsoleVariable* variable)
+{
+  for (TObjectIterator<AMyNetworkPluginCharacter> it; it; ++it)
+  {
+    if (it->HasActorBegunPlay() && !it->IsTemplate())
+    {
+      it->ApplyCostReduction();
+    }
+  }
+}
+
+static int32 GCharacterReduceCost = 1;
+static FAutoConsoleVariableRef CVarCharacterReduceCost(
+  TEXT("Character.ReduceCost"),
+  GCharacterReduceCost,
+  TEXT("1: characters nobody looks through skip pose updates while not rendered, throttle them by screen size and do not tick their camera boom, 0: all characters tick everything"),
+  FConsoleVariableDelegate::CreateStatic(&OnCharacterReduceCostChanged));
+
+static FAutoConsoleCommandWithWorld CharacterTickCostCommand(
+  TEXT("Character.TickCost"),
+  TEXT("Prints the average game thread tick time of the mesh and the movement of every character, and whether it is reduced"),
+  FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+    {
+      if (!world) return;
+
+      for (TActorIterator<AMyNetworkPluginCharacter> it(world); it; ++it)
+      {
+        const UMyNetworkPluginCharacterMeshComponent* mesh = Cast<UMyNetworkPluginCharacterMeshComponent>(it->GetMesh());
+        const UMyNetworkPluginCharacterMovementComponent* movement = Cast<UMyNetworkPluginCharacterMovementComponent>(it->GetCharacterMovement());
+        const APlayerState* playerState = it->GetPlayerState();
+        UE_LOG(LogTemplateCharacter, Display, TEXT("%s (%s): mesh %.3f ms, movement %.3f ms, anim tick option %d, camera boom %s"),
+          playerState ? *playerState->GetPlayerName() : *it->GetName(),
+          *UEnum::GetValueAsString(it->GetLocalRole()),
+          mesh ? mesh->GetTickCost().AverageMs : 0.0f,
+          movement ? movement->GetTickCost().AverageMs : 0.0f,
+          it->GetMesh() ? static_cast<int32>(it->GetMesh()->VisibilityBasedAnimTickOption) : -1,
+          it->GetCameraBoom() && it->GetCameraBoom()->IsComponentTickEnabled() ? TEXT("ticking") : TEXT("off"));
+      }
+    }));
+
+static FAutoConsoleCommandWithWorldAndArgs NetBenchCharacterCostCommand(
+  TEXT("NetBench.CharacterCost"),
+  TEXT("NetBench.CharacterCost [NumCharacters] [SecondsPerPhase]: server tick time and tick time per character with and without Character.ReduceCost, run on the host"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UNetBenchmarkSubsystem* benchmark = world && world->GetGameInstance() ? world->GetGameInstance()->GetSubsystem<UNetBenchmarkSubsystem>() : nullptr;
+      if (!benchmark) return;
+
+      const int32 numCharacters = args.IsValidIndex(0) ? FCString::Atoi(*args[0]) : 64;
+      const float seconds = args.IsValidIndex(1) ? FCString::Atof(*args[1]) : 10.0f;
+      const int32 previousSetting = GCharacterReduceCost;
+      TWeakObjectPtr<UWorld> weakWorld = world;
+
+      auto addResults = [weakWorld](FJsonObject& result)
+        {
+          int32 numMeasured = 0;
+          float meshMs = 0.0f;
+          float movementMs = 0.0f;
+          for (TActorIterator<AMyNetworkPluginCharacter> it(weakWorld.Get()); it; ++it)
+          {
+            const UMyNetworkPluginCharacterMeshComponent* mesh = Cast<UMyNetworkPluginCharacterMeshComponent>(it->GetMesh());
+            const UMyNetworkPluginCharacterMovementComponent* movement = Cast<UMyNetworkPluginCharacterMovementComponent>(it->GetCharacterMovement());
+            if (!mesh || !movement) continue;
+
+            ++numMeasured;
+            meshMs += mesh->GetTickCost().AverageMs;
+            movementMs += movement->GetTickCost().AverageMs;
+          }
+          result.SetNumberField(TEXT("characters"), numMeasured);
+          result.SetNumberField(TEXT("meshTickMsPerCharacter"), numMeasured > 0 ? meshMs / numMeasured : 0.0f);
+          result.SetNumberField(TEXT("movementTickMsPerCharacter"), numMeasured > 0 ? movementMs / numMeasured : 0.0f);
+        };
+
+      TArray<FServerTickBenchmarkPhase> phases;
+      for (int32 reduceCost : { 0, 1 })
+      {
+        FServerTickBenchmarkPhase& phase = phases.AddDefaulted_GetRef();
+        phase.Name = reduceCost ? TEXT("ReducedCost") : TEXT("FullCost");
+        phase.Begin = [reduceCost]() { CVarCharacterReduceCost->Set(reduceCost, ECVF_SetByCode); };
+        phase.AddResults = addResults;
+      }
+      phases.Last().End = [previousSetting]() { CVarCharacterReduceCost->Set(previousSetting, ECVF_SetByCode); };
+
+      benchmark->StartServerTickBenchmark(TEXT("CharacterCost"), numCharacters, seconds, MoveTemp(phases));
+    }));
+
 //////////////////////////////////////////////////////////////////////////
 // AMyNetworkPluginCharacter
 
-AMyNetworkPluginCharacter::AMyNetworkPluginCharacter() :
+AMyNetworkPluginCharacter::AMyNetworkPluginCharacter(const FObjectInitializer& ObjectInitializer) :
+  Super(ObjectInitializer
+    .SetDefaultSubobjectClass<UMyNetworkPluginCharacterMovementComponent>(ACharacter::CharacterMovementComponentName)
+    .SetDefaultSubobjectClass<UMyNetworkPluginCharacterMeshComponent>(ACharacter::MeshComponentName)),
   CreateSessionCompleteDelegate(FOnCreateSessionCompleteDelegate::CreateUObject(this, &ThisClass::OnCreateSessionComplete)),
   FindSessionsCompleteDelegate(FOnFindSessionsCompleteDelegate::CreateUObject(this, &ThisClass::OnFindSessionsComplete)),
   JoinSessionCompleteDelegate(FOnJoinSessionCompleteDelegate::CreateUObject(this, &ThisClass::OnJoinSessionComplete))
@@ -60,20 +160,133 @@ AMyNetworkPluginCharacter::AMyNetworkPluginCharacter() :
 
   // Note: The skeletal mesh and anim blueprint references on the Mesh component (inherited from Character) 
   // are set in the derived blueprint asset named ThirdPersonCharacter (to avoid direct content references in C++)
+}
+
+void AMyNetworkPluginCharacter::BeginPlay()
+{
+  // Call the base class  
+  Super::BeginPlay();
+
+  DefaultAnimTickOption = GetMesh()->VisibilityBasedAnimTickOption;
+  bDefaultUpdateRateOptimizations = GetMesh()->bEnableUpdateRateOptimizations;
+  ApplyCostReduction();
 
-  IOnlineSubsystem* onlineSubsystem = IOnlineSubsystem::Get();
-  if (onlineSubsystem)
+  // the server keeps a history of where characters were for hit validation
+  if (HasAuthority())
   {
-    OnlineSessionInterface = onlineSubsystem->GetSessionInterface();
+    if (ULagCompensationSubsystem* lagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>())
+    {
+      lagCompensation->RegisterCharacter(this);
+    }
+  }
+}
 
-    //Debug::Print("Found subsytem " + onlineSubsystem->GetSubsystemName().ToString(), FColor::Green, 15.0f);
+void AMyNetworkPluginCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+  if (ULagCompensationSubsystem* lagCompensation = GetWorld()->GetSubsystem<ULagCompensationSubsystem>())
+  {
+    lagCompensation->UnregisterCharacter(this);
   }
+
+  Super::EndPlay(EndPlayReason);
 }
 
-void AMyNetworkPluginCharacter::BeginPlay()
+void AMyNetworkPluginCharacter::NotifyControllerChanged()
 {
-  // Call the base class  
-  Super::BeginPlay();
+  Super::NotifyControllerChanged();
+
+  if (HasActorBegunPlay())
+  {
+    ApplyCostReduction();
+  }
+}
+
+void AMyNetworkPluginCharacter::BecomeViewTarget(APlayerController* PC)
+{
+  Super::BecomeViewTarget(PC);
+
+  if (HasActorBegunPlay())
+  {
+    ApplyCostReduction();
+  }
+}
+
+void AMyNetworkPluginCharacter::EndViewTarget(APlayerController* PC)
+{
+  Super::EndViewTarget(PC);
+
+  // the player controller views its new target already
+  if (HasActorBegunPlay())
+  {
+    ApplyCostReduction();
+  }
+}
+
+void AMyNetworkPluginCharacter::ApplyCostReduction()
+{
+  // the player controlling this character or spectating it, AI characters on the server are locally controlled too
+  bool bViewed = IsLocallyControlled() && IsPlayerControlled();
+  for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it && !bViewed; ++it)
+  {
+    const APlayerController* playerController = it->Get();
+    bViewed = playerController && playerController->IsLocalController() && playerController->GetViewTarget() == this;
+  }
+  const bool bReduce = GCharacterReduceCost != 0 && !bViewed;
+
+  USkeletalMeshComponent* mesh = GetMesh();
+  mesh->VisibilityBasedAnimTickOption = bReduce ? EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered : DefaultAnimTickOption;
+  mesh->bEnableUpdateRateOptimizations = bReduce || bDefaultUpdateRateOptimizations;
+
+  // the boom traces for camera collision every tick, only the camera of a viewed character is used
+  CameraBoom->SetComponentTickEnabled(!bReduce);
+}
+
+void AMyNetworkPluginCharacter::PostInitProperties()
+{
+  Super::PostInitProperties();
+
+  QuantizedMovement.Quantization.LocationCm = FMath::Max(QuantizedLocationCm, UE_KINDA_SMALL_NUMBER);
+  QuantizedMovement.Quantization.VelocityCmPerSecond = FMath::Max(QuantizedVelocityCmPerSecond, UE_KINDA_SMALL_NUMBER);
+  QuantizedMovement.Quantization.YawBits = FMath::Clamp(QuantizedYawBits, 4, 16);
+  QuantizedMovement.Quantization.PitchRollBits = FMath::Clamp(QuantizedPitchRollBits, 4, 16);
+  QuantizedMovement.MaxBaseAgeSeconds = QuantizedMaxBaseAgeSeconds;
+}
+
+void AMyNetworkPluginCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+  Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+  DOREPLIFETIME_CONDITION(AMyNetworkPluginCharacter, QuantizedMovement, COND_SimulatedOnly);
+}
+
+void AMyNetworkPluginCharacter::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+  // gathers the current movement into ReplicatedMovement
+  Super::PreReplication(ChangedPropertyTracker);
+
+  const bool bQuantized = IsReplicatingMovement() && FQuantizedCharacterMovement::IsEnabled();
+  if (bQuantized)
+  {
+    const FRepMovement& repMovement = GetReplicatedMovement();
+    QuantizedMovement.Current = FQuantizedMovementState::Quantize(QuantizedMovement.Quantization, repMovement.Location, repMovement.Rotation, repMovement.LinearVelocity);
+  }
+
+  // only one of the two goes out, the switch is seen by all connections on their next update
+  DOREPLIFETIME_ACTIVE_OVERRIDE_FAST(AMyNetworkPluginCharacter, QuantizedMovement, bQuantized);
+  DOREPLIFETIME_ACTIVE_OVERRIDE_PRIVATE_PROPERTY(AActor, ReplicatedMovement, IsReplicatingMovement() && !bQuantized);
+}
+
+void AMyNetworkPluginCharacter::PostRepNotifies()
+{
+  Super::PostRepNotifies();
+
+  if (!QuantizedMovement.bReceived) return;
+  QuantizedMovement.bReceived = false;
+
+  // applied through the same path as ReplicatedMovement so the movement component smooths it the same way
+  FRepMovement& repMovement = GetReplicatedMovement_Mutable();
+  QuantizedMovement.Received.Dequantize(QuantizedMovement.Quantization, repMovement.Location, repMovement.Rotation, repMovement.LinearVelocity);
+  OnRep_ReplicatedMovement();
 }
 
 #pragma region CharacterThings
@@ -147,9 +360,23 @@ void AMyNetworkPluginCharacter::Look(const FInputActionValue& Value)
 }
 #pragma endregion
 
+IOnlineSessionPtr AMyNetworkPluginCharacter::GetOnlineSessionInterface()
+{
+  // the sessions subsystem resolves the online subsystem once for the game instance, with its NULL fallback
+  if (!OnlineSessionInterface.IsValid())
+  {
+    UGameInstance* gameInstance = GetGameInstance();
+    if (UMultiplayerSessionsSubsystem* sessions = gameInstance ? gameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr)
+    {
+      OnlineSessionInterface = sessions->GetSessionInterface();
+    }
+  }
+  return OnlineSessionInterface;
+}
+
 void AMyNetworkPluginCharacter::CreateGameSession()
 {
-  if (!OnlineSessionInterface.IsValid()) return;
+  if (!GetOnlineSessionInterface().IsValid()) return;
 
   // Delete the session if exists already
   auto existingSession = OnlineSessionInterface->GetNamedSession(NAME_GameSession);
@@ -180,7 +407,7 @@ void AMyNetworkPluginCharacter::CreateGameSession()
 void AMyNetworkPluginCharacter::JoinGameSession()
 {
   // Find game sessions
-  if (!OnlineSessionInterface.IsValid()) return;
+  if (!GetOnlineSessionInterface().IsValid()) return;
 
   OnlineSessionInterface->AddOnFindSessionsCompleteDelegate_Handle(FindSessionsCompleteDelegate);
 
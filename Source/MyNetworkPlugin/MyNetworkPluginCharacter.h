@@ -4,8 +4,10 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "Components/SkinnedMeshComponent.h"
 #include "Logging/LogMacros.h"
 #include "Interfaces/OnlineSessionInterface.h"
+#include "QuantizedCharacterMovement.h"
 #include "MyNetworkPluginCharacter.generated.h"
 
 class USpringArmComponent;
@@ -23,13 +25,21 @@ class AMyNetworkPluginCharacter : public ACharacter
 	GENERATED_BODY()
 
 public:
-	AMyNetworkPluginCharacter();
+	AMyNetworkPluginCharacter(const FObjectInitializer& ObjectInitializer);
 	
 	/** Returns CameraBoom subobject **/
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
 	/** Returns FollowCamera subobject **/
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
 
+	/**
+	 * Cuts the cost of characters no local player looks through, neither as its pawn nor as its view target, while
+	 * Character.ReduceCost is on: their mesh only ticks montages when it is not rendered, so root motion keeps working,
+	 * updates less often the smaller it is on screen, and their camera boom does not tick. Applied when play begins,
+	 * whenever the controller changes and whenever a local player starts or stops viewing the character.
+	 */
+	void ApplyCostReduction();
+
 protected:
 
 	/** Called for movement input */
@@ -43,6 +53,16 @@ protected:
 	
 	// To add mapping context
 	virtual void BeginPlay();
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void NotifyControllerChanged() override;
+	virtual void BecomeViewTarget(APlayerController* PC) override;
+	virtual void EndViewTarget(APlayerController* PC) override;
+
+	// AActor interface
+	virtual void PostInitProperties() override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	virtual void PostRepNotifies() override;
 
 protected:
 	/** Camera boom positioning the camera behind the character */
@@ -69,6 +89,31 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
 	UInputAction* LookAction;
 
+	/** Movement sent to simulated proxies in place of ReplicatedMovement while net.QuantizedCharacterMovement is on */
+	UPROPERTY(Replicated)
+	FQuantizedCharacterMovement QuantizedMovement;
+
+	// Quantization steps of QuantizedMovement, server and clients need the same values
+	UPROPERTY(Config)
+	float QuantizedLocationCm = 1.0f;
+
+	UPROPERTY(Config)
+	float QuantizedVelocityCmPerSecond = 2.0f;
+
+	UPROPERTY(Config)
+	int32 QuantizedYawBits = 12;
+
+	UPROPERTY(Config)
+	int32 QuantizedPitchRollBits = 8;
+
+	// Updates older than this are sent as full states instead of deltas
+	UPROPERTY(Config)
+	float QuantizedMaxBaseAgeSeconds = 0.5f;
+
+	// Mesh settings of the blueprint, restored when the cost reduction does not apply
+	EVisibilityBasedAnimTickOption DefaultAnimTickOption = EVisibilityBasedAnimTickOption::AlwaysTickPose;
+	bool bDefaultUpdateRateOptimizations = false;
+
 	// ************* //
 	// Online system //
 	// ************* //
@@ -85,7 +130,9 @@ protected:
 	void OnJoinSessionComplete(FName sessionName, EOnJoinSessionCompleteResult::Type result);
 
 public:
-	// Online subsystem
+	// Online subsystem, resolved on first use
+	IOnlineSessionPtr GetOnlineSessionInterface();
+
 	IOnlineSessionPtr OnlineSessionInterface = nullptr;
 
 private:
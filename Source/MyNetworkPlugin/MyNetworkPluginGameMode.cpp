@@ -2,6 +2,7 @@
 
 #include "MyNetworkPluginGameMode.h"
 #include "MyNetworkPluginCharacter.h"
+#include "NetBandwidthGovernorComponent.h"
 #include "UObject/ConstructorHelpers.h"
 
 AMyNetworkPluginGameMode::AMyNetworkPluginGameMode()
@@ -12,4 +13,20 @@ AMyNetworkPluginGameMode::AMyNetworkPluginGameMode()
 	{
 		DefaultPawnClass = PlayerPawnBPClass.Class;
 	}
+
+	BandwidthGovernor = CreateDefaultSubobject<UNetBandwidthGovernorComponent>(TEXT("BandwidthGovernor"));
+}
+
+void AMyNetworkPluginGameMode::PostLogin(APlayerController* newplayer)
+{
+	Super::PostLogin(newplayer);
+
+	BandwidthGovernor->Rebalance();
+}
+
+void AMyNetworkPluginGameMode::Logout(AController* exiting)
+{
+	Super::Logout(exiting);
+
+	BandwidthGovernor->Rebalance(exiting);
 }
@@ -6,6 +6,8 @@
 #include "GameFramework/GameModeBase.h"
 #include "MyNetworkPluginGameMode.generated.h"
 
+class UNetBandwidthGovernorComponent;
+
 UCLASS(minimalapi)
 class AMyNetworkPluginGameMode : public AGameModeBase
 {
@@ -13,6 +15,14 @@ class AMyNetworkPluginGameMode : public AGameModeBase
 
 public:
 	AMyNetworkPluginGameMode();
+
+	virtual void PostLogin(APlayerController* newplayer) override;
+	virtual void Logout(AController* exiting) override;
+
+protected:
+	/** Splits the host upstream between the connected players */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Network)
+	UNetBandwidthGovernorComponent* BandwidthGovernor;
 };
 
 
@@ -0,0 +1,463 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ConnectionMemorySubsystem.h"
+#include "Engine/ActorChannel.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/GameSession.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "IPAddress.h"
+#include "JoinAdmissionComponent.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Net/DataReplication.h"
+#include "Serialization/ArchiveCountMem.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogConnectionMemory, Log, All);
+
+static float GConnectionMemoryCsvIntervalSeconds = 0.0f;
+static FAutoConsoleVariableRef CVarConnectionMemoryCsvIntervalSeconds(
+  TEXT("net.ConnectionMemory.CsvIntervalSeconds"),
+  GConnectionMemoryCsvIntervalSeconds,
+  TEXT("Seconds between the rows the host appends to Saved/Profiling/ConnectionMemory-*.csv, one per client connection and the total, 0 to not write any"));
+
+static float GConnectionMemoryClientTimeoutSeconds = 60.0f;
+static FAutoConsoleVariableRef CVarConnectionMemoryClientTimeoutSeconds(
+  TEXT("net.ConnectionMemory.ClientTimeoutSeconds"),
+  GConnectionMemoryClientTimeoutSeconds,
+  TEXT("Seconds NetBench.ConnectionMemory waits for the clients of a step to play before it ends the benchmark"));
+
+// The join admission of the lobby lets 2 clients in per second. Clients it queues retry every few seconds like any
+// client, which stretches the step and puts the queue into what is measured, so they are launched no faster than that.
+static float GConnectionMemoryLaunchIntervalSeconds = 0.6f;
+static FAutoConsoleVariableRef CVarConnectionMemoryLaunchIntervalSeconds(
+  TEXT("net.ConnectionMemory.LaunchIntervalSeconds"),
+  GConnectionMemoryLaunchIntervalSeconds,
+  TEXT("Seconds between the launches of the headless clients of NetBench.ConnectionMemory, keep it above 1 / JoinsPerSecond of the join admission"));
+
+static FString GConnectionMemoryClientExecutable;
+static FAutoConsoleVariableRef CVarConnectionMemoryClientExecutable(
+  TEXT("net.ConnectionMemory.ClientExecutable"),
+  GConnectionMemoryClientExecutable,
+  TEXT("Executable NetBench.ConnectionMemory launches the headless clients with, empty for the one of the host. Set it when the host is a server only build."));
+
+static FAutoConsoleCommandWithWorld NetConnectionMemoryCommand(
+  TEXT("Net.ConnectionMemory"),
+  TEXT("Net.ConnectionMemory: logs the host memory of every client connection by category and the total"),
+  FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+    {
+      if (const UConnectionMemorySubsystem* connectionMemory = world ? world->GetSubsystem<UConnectionMemorySubsystem>() : nullptr)
+      {
+        connectionMemory->LogConnectionMemory();
+      }
+    }));
+
+static FAutoConsoleCommandWithWorldAndArgs NetBenchConnectionMemoryCommand(
+  TEXT("NetBench.ConnectionMemory"),
+  TEXT("NetBench.ConnectionMemory [MaxClients=16] [SecondsPerStep=10]: launches 1, 2, 4... headless clients up to MaxClients and reports the memory per player at every step, run on the host"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UConnectionMemorySubsystem* connectionMemory = world ? world->GetSubsystem<UConnectionMemorySubsystem>() : nullptr;
+      if (!connectionMemory) return;
+
+      const int32 maxClients = args.IsValidIndex(0) ? FCString::Atoi(*args[0]) : 16;
+      const float secondsPerStep = args.IsValidIndex(1) ? FCString::Atof(*args[1]) : 10.0f;
+      connectionMemory->StartClientBenchmark(maxClients, secondsPerStep);
+    }));
+
+static SIZE_T CountObjectBytes(const UObject* object)
+{
+  return object ? FArchiveCountMem(object).GetMax() : 0;
+}
+
+static SIZE_T CountActorBytes(const AActor* actor)
+{
+  if (!actor) return 0;
+
+  SIZE_T bytes = CountObjectBytes(actor);
+  for (const UActorComponent* component : actor->GetComponents())
+  {
+    bytes += CountObjectBytes(component);
+  }
+  return bytes;
+}
+
+static const TCHAR* ConnectionMemoryCsvHeader = TEXT("seconds,connection,channels,connectionBytes,channelBytes,replicatedStateBytes,controllerBytes,pawnBytes,totalBytes\n");
+
+static FString ToCsvRow(double seconds, const FConnectionMemory& memory)
+{
+  return FString::Printf(TEXT("%.3f,%s,%d,%llu,%llu,%llu,%llu,%llu,%llu\n"), seconds, *memory.Name, memory.NumChannels,
+    static_cast<uint64>(memory.ConnectionBytes), static_cast<uint64>(memory.ChannelBytes), static_cast<uint64>(memory.ReplicatedStateBytes),
+    static_cast<uint64>(memory.ControllerBytes), static_cast<uint64>(memory.PawnBytes), static_cast<uint64>(memory.GetTotalBytes()));
+}
+
+void FConnectionMemory::Accumulate(const FConnectionMemory& other)
+{
+  NumChannels += other.NumChannels;
+  ConnectionBytes += other.ConnectionBytes;
+  ChannelBytes += other.ChannelBytes;
+  ReplicatedStateBytes += other.ReplicatedStateBytes;
+  ControllerBytes += other.ControllerBytes;
+  PawnBytes += other.PawnBytes;
+}
+
+bool UConnectionMemorySubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+  return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UConnectionMemorySubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+  Super::OnWorldBeginPlay(InWorld);
+
+  if (InWorld.GetNetMode() == NM_Client) return;
+
+  TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &ThisClass::Tick));
+}
+
+void UConnectionMemorySubsystem::Deinitialize()
+{
+  // the clients would stay connected to nothing
+  if (IsBenchmarkRunning())
+  {
+    FinishClientBenchmark();
+  }
+  FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+
+  Super::Deinitialize();
+}
+
+FConnectionMemory UConnectionMemorySubsystem::CollectConnectionMemory(TArray<FConnectionMemory>& outConnections) const
+{
+  FConnectionMemory total;
+  total.Name = TEXT("Total");
+
+  const UNetDriver* netDriver = GetWorld()->GetNetDriver();
+  if (!netDriver) return total;
+
+  outConnections.Reserve(outConnections.Num() + netDriver->ClientConnections.Num());
+  for (UNetConnection* connection : netDriver->ClientConnections)
+  {
+    if (!connection) continue;
+
+    total.Accumulate(outConnections.Add_GetRef(CountConnectionMemory(connection)));
+  }
+  return total;
+}
+
+FConnectionMemory UConnectionMemorySubsystem::CountConnectionMemory(UNetConnection* connection)
+{
+  FConnectionMemory memory;
+  memory.Name = connection->LowLevelGetRemoteAddress(true);
+  memory.ConnectionBytes = CountObjectBytes(connection) + CountObjectBytes(connection->PackageMap);
+
+  for (const UChannel* channel : connection->OpenChannels)
+  {
+    const UActorChannel* actorChannel = Cast<UActorChannel>(channel);
+    if (!actorChannel)
+    {
+      // control and voice channels belong to the connection itself
+      memory.ConnectionBytes += CountObjectBytes(channel);
+      continue;
+    }
+
+    SIZE_T replicatedStateBytes = 0;
+    for (const TPair<UObject*, TSharedRef<FObjectReplicator>>& replicator : actorChannel->ReplicationMap)
+    {
+      FArchiveCountMem replicatorArchive(nullptr);
+      replicator.Value->CountBytes(replicatorArchive);
+      replicatedStateBytes += replicatorArchive.GetMax();
+    }
+
+    // the channel counts its replicators as well
+    const SIZE_T channelBytes = CountObjectBytes(actorChannel);
+    ++memory.NumChannels;
+    memory.ChannelBytes += channelBytes > replicatedStateBytes ? channelBytes - replicatedStateBytes : 0;
+    memory.ReplicatedStateBytes += replicatedStateBytes;
+  }
+
+  if (const APlayerController* playerController = connection->PlayerController)
+  {
+    memory.ControllerBytes = CountActorBytes(playerController) + CountActorBytes(playerController->PlayerState);
+    memory.PawnBytes = CountActorBytes(playerController->GetPawn());
+  }
+  return memory;
+}
+
+void UConnectionMemorySubsystem::LogConnectionMemory() const
+{
+  TArray<FConnectionMemory> connections;
+  const FConnectionMemory total = CollectConnectionMemory(connections);
+
+  const auto logRow = [](const FConnectionMemory& memory)
+    {
+      UE_LOG(LogConnectionMemory, Display, TEXT("%-24s %8d %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f"), *memory.Name, memory.NumChannels,
+        memory.ConnectionBytes / 1024.0, memory.ChannelBytes / 1024.0, memory.ReplicatedStateBytes / 1024.0,
+        memory.ControllerBytes / 1024.0, memory.PawnBytes / 1024.0, memory.GetTotalBytes() / 1024.0);
+    };
+
+  UE_LOG(LogConnectionMemory, Display, TEXT("%-24s %8s %12s %12s %12s %12s %12s %12s"), TEXT("Connection"), TEXT("Channels"),
+    TEXT("Conn KB"), TEXT("Channel KB"), TEXT("RepState KB"), TEXT("Control KB"), TEXT("Pawn KB"), TEXT("Total KB"));
+  for (const FConnectionMemory& memory : connections)
+  {
+    logRow(memory);
+  }
+  logRow(total);
+
+  if (connections.Num() > 0)
+  {
+    UE_LOG(LogConnectionMemory, Display, TEXT("%d connections, %.1f KB per player"), connections.Num(), total.GetTotalBytes() / 1024.0 / connections.Num());
+  }
+}
+
+int32 UConnectionMemorySubsystem::GetNumPlayingClients() const
+{
+  const UNetDriver* netDriver = GetWorld()->GetNetDriver();
+  if (!netDriver) return 0;
+
+  int32 numPlaying = 0;
+  for (const UNetConnection* connection : netDriver->ClientConnections)
+  {
+    numPlaying += connection && connection->PlayerController && connection->PlayerController->GetPawn() ? 1 : 0;
+  }
+  return numPlaying;
+}
+
+bool UConnectionMemorySubsystem::Tick(float deltaTime)
+{
+  const double now = FPlatformTime::Seconds();
+
+  if (GConnectionMemoryCsvIntervalSeconds > 0.0f && now >= NextCsvSeconds)
+  {
+    NextCsvSeconds = now + GConnectionMemoryCsvIntervalSeconds;
+    WriteCsvRows();
+  }
+
+  if (!IsBenchmarkRunning()) return true;
+
+  if (StepPlayingSeconds == 0.0)
+  {
+    // one client at a time, the timeout counts from the last launch
+    if (ClientProcesses.Num() < BenchmarkStepClients)
+    {
+      if (now >= NextLaunchSeconds)
+      {
+        if (!LaunchClient())
+        {
+          FinishClientBenchmark();
+          return true;
+        }
+        NextLaunchSeconds = now + GConnectionMemoryLaunchIntervalSeconds;
+        StepStartSeconds = now;
+      }
+    }
+    else if (GetNumPlayingClients() >= BenchmarkStepClients)
+    {
+      StepPlayingSeconds = now;
+    }
+    else if (now - StepStartSeconds > GConnectionMemoryClientTimeoutSeconds)
+    {
+      UE_LOG(LogConnectionMemory, Warning, TEXT("Only %d of %d clients play after %.0f seconds."), GetNumPlayingClients(), BenchmarkStepClients, GConnectionMemoryClientTimeoutSeconds);
+      RecordBenchmarkStep(true);
+      FinishClientBenchmark();
+    }
+  }
+  else if (now - StepPlayingSeconds >= BenchmarkSecondsPerStep)
+  {
+    RecordBenchmarkStep(false);
+    if (BenchmarkStepClients >= BenchmarkMaxClients)
+    {
+      FinishClientBenchmark();
+    }
+    else
+    {
+      StartNextBenchmarkStep();
+    }
+  }
+  return true;
+}
+
+void UConnectionMemorySubsystem::WriteCsvRows()
+{
+  TArray<FConnectionMemory> connections;
+  const FConnectionMemory total = CollectConnectionMemory(connections);
+
+  FString rows;
+  if (CsvPath.IsEmpty())
+  {
+    CsvPath = FPaths::ProjectSavedDir() / TEXT("Profiling") / FString::Printf(TEXT("ConnectionMemory-%s.csv"), *FDateTime::Now().ToString());
+    rows = ConnectionMemoryCsvHeader;
+  }
+
+  const double seconds = GetWorld()->GetTimeSeconds();
+  for (const FConnectionMemory& memory : connections)
+  {
+    rows += ToCsvRow(seconds, memory);
+  }
+  rows += ToCsvRow(seconds, total);
+
+  if (!FFileHelper::SaveStringToFile(rows, *CsvPath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM, &IFileManager::Get(), FILEWRITE_Append))
+  {
+    UE_LOG(LogConnectionMemory, Warning, TEXT("Could not write %s, stopping the dump."), *CsvPath);
+    GConnectionMemoryCsvIntervalSeconds = 0.0f;
+  }
+}
+
+void UConnectionMemorySubsystem::StartClientBenchmark(int32 maxClients, float secondsPerStep)
+{
+  if (IsBenchmarkRunning())
+  {
+    UE_LOG(LogConnectionMemory, Warning, TEXT("A benchmark is already running."));
+    return;
+  }
+  if (!TickerHandle.IsValid() || !GetWorld()->GetNetDriver())
+  {
+    UE_LOG(LogConnectionMemory, Warning, TEXT("NetBench.ConnectionMemory runs on a listen or dedicated server."));
+    return;
+  }
+
+  // clients past the capacity of the session are rejected as full, they would only end the benchmark as a timeout
+  const AGameModeBase* gameMode = GetWorld()->GetAuthGameMode();
+  const UJoinAdmissionComponent* admission = gameMode ? gameMode->FindComponentByClass<UJoinAdmissionComponent>() : nullptr;
+  const int32 capacity = admission ? admission->GetCapacity() : gameMode && gameMode->GameSession ? gameMode->GameSession->MaxPlayers : 0;
+  const int32 freeSlots = capacity > 0 ? capacity - gameMode->GetNumPlayers() : MAX_int32;
+  if (freeSlots < 1)
+  {
+    UE_LOG(LogConnectionMemory, Error, TEXT("NetBench.ConnectionMemory needs a free slot, the session of %d players is full. Host it with more public connections."), capacity);
+    return;
+  }
+  if (maxClients > freeSlots)
+  {
+    UE_LOG(LogConnectionMemory, Warning, TEXT("The session has room for %d more players, NetBench.ConnectionMemory runs up to %d clients instead of %d. Host it with more public connections to measure more."),
+      freeSlots, freeSlots, maxClients);
+  }
+
+  BenchmarkMaxClients = FMath::Clamp(maxClients, 1, freeSlots);
+  BenchmarkSecondsPerStep = FMath::Max(secondsPerStep, 1.0f);
+  Report = MakeUnique<FNetBenchmarkReport>(TEXT("ConnectionMemory"));
+  Report->Root->SetNumberField(TEXT("maxClients"), BenchmarkMaxClients);
+  Report->Root->SetNumberField(TEXT("requestedMaxClients"), maxClients);
+  Report->Root->SetNumberField(TEXT("capacity"), capacity);
+  Report->Root->SetNumberField(TEXT("secondsPerStep"), BenchmarkSecondsPerStep);
+  Report->Root->SetStringField(TEXT("map"), GetWorld()->GetMapName());
+  StepRows.Reset();
+
+  // the first step measures the host without benchmark clients, the memory per player is relative to it
+  BenchmarkStepClients = 0;
+  StepStartSeconds = FPlatformTime::Seconds();
+  StepPlayingSeconds = StepStartSeconds;
+}
+
+bool UConnectionMemorySubsystem::LaunchClient()
+{
+  const FString executable = GConnectionMemoryClientExecutable.IsEmpty() ? FString(FPlatformProcess::ExecutablePath()) : GConnectionMemoryClientExecutable;
+  FString params;
+#if WITH_EDITOR
+  // the editor executable needs the project, a packaged game knows its own
+  if (GConnectionMemoryClientExecutable.IsEmpty())
+  {
+    params = FString::Printf(TEXT("\"%s\" "), *FPaths::ConvertRelativePathToFull(FPaths::GetProjectFilePath()));
+  }
+#endif
+  // the port the net driver listens on, the world URL keeps the default port when another one was bound
+  UNetDriver* netDriver = GetWorld()->GetNetDriver();
+  const TSharedPtr<const FInternetAddr> localAddr = netDriver ? netDriver->GetLocalAddr() : nullptr;
+  const int32 port = localAddr.IsValid() ? localAddr->GetPort() : GetWorld()->URL.Port;
+  params += FString::Printf(TEXT("127.0.0.1:%d -game -nullrhi -nosound -nosplash -nosteam -unattended -log=ConnectionMemoryClient%d.log"),
+    port, ClientProcesses.Num());
+
+  FProcHandle process = FPlatformProcess::CreateProc(*executable, *params, true, true, true, nullptr, 0, nullptr, nullptr);
+  if (!process.IsValid())
+  {
+    UE_LOG(LogConnectionMemory, Warning, TEXT("Could not launch %s %s"), *executable, *params);
+    return false;
+  }
+
+  ClientProcesses.Add(process);
+  return true;
+}
+
+void UConnectionMemorySubsystem::StartNextBenchmarkStep()
+{
+  BenchmarkStepClients = FMath::Min(FMath::Max(BenchmarkStepClients * 2, 1), BenchmarkMaxClients);
+  StepStartSeconds = FPlatformTime::Seconds();
+  StepPlayingSeconds = 0.0;
+  NextLaunchSeconds = StepStartSeconds;
+
+  // Tick launches the clients missing for the step one after another
+  UE_LOG(LogConnectionMemory, Display, TEXT("Launching clients and waiting for %d of them to play."), BenchmarkStepClients);
+}
+
+void UConnectionMemorySubsystem::RecordBenchmarkStep(bool bTimedOut)
+{
+  TArray<FConnectionMemory> connections;
+  const FConnectionMemory total = CollectConnectionMemory(connections);
+  const int32 numPlayers = connections.Num();
+  const double perPlayer = 1.0 / FMath::Max(numPlayers, 1);
+
+  // process memory also covers what the counting misses, e.g. the shared changelists and allocator slack
+  const uint64 usedPhysical = FPlatformMemory::GetStats().UsedPhysical;
+  if (BenchmarkStepClients == 0)
+  {
+    BaselineUsedPhysical = usedPhysical;
+  }
+  const double processBytesPerPlayer = numPlayers > 0 ? (static_cast<double>(usedPhysical) - BaselineUsedPhysical) * perPlayer : 0.0;
+
+  TSharedRef<FJsonObject> result = Report->AddResult();
+  result->SetNumberField(TEXT("clients"), BenchmarkStepClients);
+  result->SetNumberField(TEXT("connections"), numPlayers);
+  result->SetNumberField(TEXT("playingClients"), GetNumPlayingClients());
+  result->SetBoolField(TEXT("timedOut"), bTimedOut);
+  result->SetNumberField(TEXT("channels"), total.NumChannels);
+  result->SetNumberField(TEXT("connectionBytesPerPlayer"), total.ConnectionBytes * perPlayer);
+  result->SetNumberField(TEXT("channelBytesPerPlayer"), total.ChannelBytes * perPlayer);
+  result->SetNumberField(TEXT("replicatedStateBytesPerPlayer"), total.ReplicatedStateBytes * perPlayer);
+  result->SetNumberField(TEXT("controllerBytesPerPlayer"), total.ControllerBytes * perPlayer);
+  result->SetNumberField(TEXT("pawnBytesPerPlayer"), total.PawnBytes * perPlayer);
+  result->SetNumberField(TEXT("bytesPerPlayer"), total.GetTotalBytes() * perPlayer);
+  result->SetNumberField(TEXT("totalBytes"), static_cast<double>(total.GetTotalBytes()));
+  result->SetNumberField(TEXT("usedPhysicalBytes"), static_cast<double>(usedPhysical));
+  result->SetNumberField(TEXT("processBytesPerPlayer"), processBytesPerPlayer);
+
+  StepRows.Add(FString::Printf(TEXT("%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n"), BenchmarkStepClients, numPlayers,
+    total.ConnectionBytes * perPlayer, total.ChannelBytes * perPlayer, total.ReplicatedStateBytes * perPlayer,
+    total.ControllerBytes * perPlayer, total.PawnBytes * perPlayer, total.GetTotalBytes() * perPlayer, processBytesPerPlayer));
+
+  UE_LOG(LogConnectionMemory, Display, TEXT("%3d clients: %.1f KB counted and %.1f KB process memory per player"),
+    numPlayers, total.GetTotalBytes() * perPlayer / 1024.0, processBytesPerPlayer / 1024.0);
+}
+
+void UConnectionMemorySubsystem::FinishClientBenchmark()
+{
+  for (FProcHandle& process : ClientProcesses)
+  {
+    FPlatformProcess::TerminateProc(process, true);
+    FPlatformProcess::CloseProc(process);
+  }
+  ClientProcesses.Reset();
+
+  // the steps next to the report as a table to plot the memory per player over the clients
+  const FString reportPath = Report->Save();
+  if (!reportPath.IsEmpty())
+  {
+    FString table = TEXT("clients,connections,connectionBytesPerPlayer,channelBytesPerPlayer,replicatedStateBytesPerPlayer,controllerBytesPerPlayer,pawnBytesPerPlayer,bytesPerPlayer,processBytesPerPlayer\n");
+    for (const FString& row : StepRows)
+    {
+      table += row;
+    }
+    FFileHelper::SaveStringToFile(table, *FPaths::ChangeExtension(reportPath, TEXT("csv")));
+  }
+
+  Report.Reset();
+  StepRows.Reset();
+}
@@ -0,0 +1,166 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JoinAdmissionComponent.h"
+#include "MultiplayerSessionsSubsystem.h"
+#include "Engine/GameInstance.h"
+#include "Engine/NetConnection.h"
+#include "Engine/World.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/GameSession.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/PlatformTime.h"
+#include "OnlineSessionSettings.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+CSV_DEFINE_CATEGORY(JoinAdmission, true);
+
+DEFINE_LOG_CATEGORY_STATIC(LogJoinAdmission, Log, All);
+
+static FAutoConsoleCommandWithWorld NetJoinQueueCommand(
+  TEXT("Net.JoinQueue"),
+  TEXT("Prints the capacity, reservations, queue length and join tokens of the lobby admission control"),
+  FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+    {
+      AGameModeBase* gameMode = world ? world->GetAuthGameMode() : nullptr;
+      const UJoinAdmissionComponent* admission = gameMode ? gameMode->FindComponentByClass<UJoinAdmissionComponent>() : nullptr;
+      if (!admission) return;
+
+      UE_LOG(LogJoinAdmission, Display, TEXT("Players %d, reservations %d, capacity %d, queued %d, join tokens %.1f"),
+        gameMode->GetNumPlayers(), admission->GetNumReservations(), admission->GetCapacity(), admission->GetQueueLength(), admission->GetJoinTokens());
+    }));
+
+static FString GetPlayerKey(const FUniqueNetIdRepl& uniqueId, const FString& address)
+{
+  // clients without an online id, e.g. on the NULL subsystem, are told apart by their address
+  return uniqueId.IsValid() ? uniqueId.ToString() : address;
+}
+
+UJoinAdmissionComponent::UJoinAdmissionComponent()
+{
+  PrimaryComponentTick.bCanEverTick = false;
+}
+
+FString UJoinAdmissionComponent::AdmitPlayer(const FUniqueNetIdRepl& uniqueId, const FString& address)
+{
+  const double now = FPlatformTime::Seconds();
+  RefillJoinTokens(now);
+  RemoveExpired(now);
+
+  const FString playerKey = GetPlayerKey(uniqueId, address);
+
+  // a client that reconnects before its login finished keeps its slot
+  if (double* reservationExpireTime = Reservations.Find(playerKey))
+  {
+    *reservationExpireTime = now + ReservationTimeoutSeconds;
+    return FString();
+  }
+
+  const AGameModeBase* gameMode = Cast<AGameModeBase>(GetOwner());
+  const int32 capacity = GetCapacity();
+  const int32 freeSlots = capacity - gameMode->GetNumPlayers() - Reservations.Num();
+
+  // players hold every slot and no reservation can lapse to free one, waiting in the queue would not help
+  if (gameMode->GetNumPlayers() >= capacity)
+  {
+    Queue.RemoveAll([&playerKey](const FJoinQueueEntry& entry) { return entry.PlayerKey == playerKey; });
+    CSV_CUSTOM_STAT(JoinAdmission, RejectedFull, 1, ECsvCustomStatOp::Accumulate);
+    return TEXT("Server is full");
+  }
+
+  // queued clients go first, a new client only gets a slot no one ahead of it is waiting for
+  const int32 queueIndex = Queue.IndexOfByPredicate([&playerKey](const FJoinQueueEntry& entry) { return entry.PlayerKey == playerKey; });
+  const int32 playersAhead = queueIndex != INDEX_NONE ? queueIndex : Queue.Num();
+
+  if (playersAhead >= freeSlots || JoinTokens < 1.0f)
+  {
+    return QueuePlayer(playerKey, now);
+  }
+
+  JoinTokens -= 1.0f;
+  if (queueIndex != INDEX_NONE)
+  {
+    Queue.RemoveAt(queueIndex);
+  }
+  Reservations.Add(playerKey, now + ReservationTimeoutSeconds);
+
+  CSV_CUSTOM_STAT(JoinAdmission, Admitted, 1, ECsvCustomStatOp::Accumulate);
+  return FString();
+}
+
+void UJoinAdmissionComponent::OnPlayerLoggedIn(APlayerController* newPlayer)
+{
+  if (!newPlayer) return;
+
+  const UNetConnection* connection = newPlayer->GetNetConnection();
+  const FUniqueNetIdRepl uniqueId = newPlayer->PlayerState ? newPlayer->PlayerState->GetUniqueId() : FUniqueNetIdRepl();
+  const FString address = connection ? connection->LowLevelGetRemoteAddress() : FString();
+
+  Reservations.Remove(GetPlayerKey(uniqueId, address));
+}
+
+int32 UJoinAdmissionComponent::GetCapacity() const
+{
+  const AGameModeBase* gameMode = Cast<AGameModeBase>(GetOwner());
+  const FName sessionName = gameMode && gameMode->GameSession ? gameMode->GameSession->SessionName : NAME_GameSession;
+
+  // the advertised player count of the session, the game session limit on servers without one
+  UGameInstance* gameInstance = GetWorld() ? GetWorld()->GetGameInstance() : nullptr;
+  UMultiplayerSessionsSubsystem* sessions = gameInstance ? gameInstance->GetSubsystem<UMultiplayerSessionsSubsystem>() : nullptr;
+  IOnlineSessionPtr sessionInterface = sessions ? sessions->GetSessionInterface() : nullptr;
+  if (const FNamedOnlineSession* session = sessionInterface.IsValid() ? sessionInterface->GetNamedSession(sessionName) : nullptr)
+  {
+    return session->SessionSettings.NumPublicConnections;
+  }
+
+  return gameMode && gameMode->GameSession ? gameMode->GameSession->MaxPlayers : 0;
+}
+
+void UJoinAdmissionComponent::RefillJoinTokens(double now)
+{
+  if (LastRefillTime <= 0.0)
+  {
+    JoinTokens = JoinBurst;
+  }
+  else
+  {
+    JoinTokens = FMath::Min(static_cast<float>(JoinBurst), JoinTokens + static_cast<float>(now - LastRefillTime) * JoinsPerSecond);
+  }
+  LastRefillTime = now;
+}
+
+void UJoinAdmissionComponent::RemoveExpired(double now)
+{
+  for (auto it = Reservations.CreateIterator(); it; ++it)
+  {
+    if (it->Value < now)
+    {
+      UE_LOG(LogJoinAdmission, Verbose, TEXT("Reservation of %s expired before login"), *it->Key);
+      it.RemoveCurrent();
+    }
+  }
+
+  Queue.RemoveAll([now](const FJoinQueueEntry& entry) { return entry.ExpireTime < now; });
+}
+
+FString UJoinAdmissionComponent::QueuePlayer(const FString& playerKey, double now)
+{
+  int32 queueIndex = Queue.IndexOfByPredicate([&playerKey](const FJoinQueueEntry& entry) { return entry.PlayerKey == playerKey; });
+  if (queueIndex == INDEX_NONE)
+  {
+    if (Queue.Num() >= MaxQueueLength)
+    {
+      CSV_CUSTOM_STAT(JoinAdmission, RejectedBusy, 1, ECsvCustomStatOp::Accumulate);
+      return TEXT("Server is busy, try again later");
+    }
+
+    queueIndex = Queue.Add({ playerKey });
+  }
+  Queue[queueIndex].ExpireTime = now + QueueEntryTimeoutSeconds;
+
+  CSV_CUSTOM_STAT(JoinAdmission, Queued, 1, ECsvCustomStatOp::Accumulate);
+  UE_LOG(LogJoinAdmission, Verbose, TEXT("Queued %s at position %d of %d"), *playerKey, queueIndex + 1, Queue.Num());
+
+  return FString::Printf(TEXT("%s%d of %d"), UMultiplayerSessionsSubsystem::JoinQueuedErrorPrefix, queueIndex + 1, Queue.Num());
+}
@@ -0,0 +1,306 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LagCompensationSubsystem.h"
+#include "NetBenchmarkSubsystem.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+
+DECLARE_STATS_GROUP(TEXT("LagCompensation"), STATGROUP_LagCompensation, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Record"), STAT_LagCompensationRecord, STATGROUP_LagCompensation);
+DECLARE_CYCLE_STAT(TEXT("Rewind"), STAT_LagCompensationRewind, STATGROUP_LagCompensation);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Characters"), STAT_LagCompensationCharacters, STATGROUP_LagCompensation);
+DECLARE_MEMORY_STAT(TEXT("History Memory"), STAT_LagCompensationMemory, STATGROUP_LagCompensation);
+
+DEFINE_LOG_CATEGORY_STATIC(LogLagCompensation, Log, All);
+
+static FAutoConsoleCommandWithWorldAndArgs NetBenchLagCompensationCommand(
+  TEXT("NetBench.LagCompensation"),
+  TEXT("NetBench.LagCompensation [NumCharacters] [Queries]: times rewind queries against the history of the characters, run on the host"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      ULagCompensationSubsystem* lagCompensation = world ? world->GetSubsystem<ULagCompensationSubsystem>() : nullptr;
+      if (!lagCompensation) return;
+
+      const int32 numCharacters = args.IsValidIndex(0) ? FCString::Atoi(*args[0]) : 64;
+      const int32 numQueries = args.IsValidIndex(1) ? FCString::Atoi(*args[1]) : 10000;
+      lagCompensation->StartRewindBenchmark(numCharacters, numQueries);
+    }));
+
+void ULagCompensationSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+  Super::Initialize(Collection);
+
+  HistoryFrames = FMath::Max(HistoryFrames, 2);
+  FrameTimes.SetNumZeroed(HistoryFrames);
+}
+
+void ULagCompensationSubsystem::Deinitialize()
+{
+  FTSTicker::GetCoreTicker().RemoveTicker(BenchmarkTickerHandle);
+
+  Super::Deinitialize();
+}
+
+TStatId ULagCompensationSubsystem::GetStatId() const
+{
+  RETURN_QUICK_DECLARE_CYCLE_STAT(ULagCompensationSubsystem, STATGROUP_LagCompensation);
+}
+
+void ULagCompensationSubsystem::Tick(float DeltaTime)
+{
+  SCOPE_CYCLE_COUNTER(STAT_LagCompensationRecord);
+
+  Super::Tick(DeltaTime);
+
+  const UWorld* world = GetWorld();
+  if (SlotIndices.Num() == 0 || world->GetNetMode() == NM_Client) return;
+
+  const uint64 frame = NextFrame++;
+  const int32 ringIndex = frame % HistoryFrames;
+  FrameTimes[ringIndex] = world->GetTimeSeconds();
+
+  for (int32 slotIndex = 0; slotIndex < Slots.Num(); ++slotIndex)
+  {
+    const ACharacter* character = Slots[slotIndex].Character.Get();
+    if (!character) continue;
+
+    const UCapsuleComponent* capsule = character->GetCapsuleComponent();
+    FSample& sample = Samples[slotIndex * HistoryFrames + ringIndex];
+    sample.Location = character->GetActorLocation();
+    sample.Rotation = FQuat4f(character->GetActorQuat());
+    sample.CapsuleRadius = capsule->GetScaledCapsuleRadius();
+    sample.CapsuleHalfHeight = capsule->GetScaledCapsuleHalfHeight();
+  }
+
+  SET_DWORD_STAT(STAT_LagCompensationCharacters, SlotIndices.Num());
+  SET_MEMORY_STAT(STAT_LagCompensationMemory, GetHistoryBytes());
+}
+
+void ULagCompensationSubsystem::RegisterCharacter(ACharacter* character)
+{
+  if (!character || SlotIndices.Contains(character)) return;
+
+  int32 slotIndex = INDEX_NONE;
+  if (FreeSlots.Num() > 0)
+  {
+    slotIndex = FreeSlots.Pop();
+  }
+  else if (Slots.Num() < MaxCharacters)
+  {
+    slotIndex = Slots.AddDefaulted();
+    Samples.AddUninitialized(HistoryFrames);
+  }
+  else
+  {
+    UE_LOG(LogLagCompensation, Warning, TEXT("No history for %s, all %d slots are in use"), *character->GetName(), MaxCharacters);
+    return;
+  }
+
+  Slots[slotIndex].Character = character;
+  Slots[slotIndex].FirstFrame = NextFrame;
+  SlotIndices.Add(character, slotIndex);
+}
+
+void ULagCompensationSubsystem::UnregisterCharacter(ACharacter* character)
+{
+  int32 slotIndex = INDEX_NONE;
+  if (!SlotIndices.RemoveAndCopyValue(character, slotIndex)) return;
+
+  Slots[slotIndex].Character.Reset();
+  FreeSlots.Add(slotIndex);
+}
+
+bool ULagCompensationSubsystem::FindFrames(double serverTime, uint64 firstFrame, uint64& outOlderFrame, uint64& outNewerFrame, float& outAlpha) const
+{
+  if (NextFrame == 0) return false;
+
+  const uint64 newestFrame = NextFrame - 1;
+  const uint64 oldestFrame = FMath::Max(NextFrame > static_cast<uint64>(HistoryFrames) ? NextFrame - HistoryFrames : 0, firstFrame);
+  if (oldestFrame > newestFrame) return false;
+
+  outAlpha = 0.0f;
+  if (serverTime <= GetFrameTime(oldestFrame))
+  {
+    outOlderFrame = outNewerFrame = oldestFrame;
+    return true;
+  }
+  if (serverTime >= GetFrameTime(newestFrame))
+  {
+    outOlderFrame = outNewerFrame = newestFrame;
+    return true;
+  }
+
+  // frame times only grow, find the two frames serverTime lies between
+  uint64 low = oldestFrame;
+  uint64 high = newestFrame;
+  while (high - low > 1)
+  {
+    const uint64 middle = low + (high - low) / 2;
+    if (GetFrameTime(middle) <= serverTime)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  const double lowTime = GetFrameTime(low);
+  const double span = GetFrameTime(high) - lowTime;
+  outOlderFrame = low;
+  outNewerFrame = high;
+  outAlpha = span > 0.0 ? static_cast<float>((serverTime - lowTime) / span) : 0.0f;
+  return true;
+}
+
+void ULagCompensationSubsystem::InterpolatePose(int32 slotIndex, double serverTime, FLagCompensationPose& outPose) const
+{
+  const FCharacterSlot& slot = Slots[slotIndex];
+  outPose.Character = slot.Character.Get();
+
+  uint64 olderFrame = 0;
+  uint64 newerFrame = 0;
+  float alpha = 0.0f;
+  if (!FindFrames(serverTime, slot.FirstFrame, olderFrame, newerFrame, alpha))
+  {
+    // registered after the last recorded frame, the current pose is all there is
+    const UCapsuleComponent* capsule = outPose.Character->GetCapsuleComponent();
+    outPose.Location = outPose.Character->GetActorLocation();
+    outPose.Rotation = outPose.Character->GetActorQuat();
+    outPose.CapsuleRadius = capsule->GetScaledCapsuleRadius();
+    outPose.CapsuleHalfHeight = capsule->GetScaledCapsuleHalfHeight();
+    return;
+  }
+
+  const FSample* history = &Samples[slotIndex * HistoryFrames];
+  const FSample& older = history[olderFrame % HistoryFrames];
+  const FSample& newer = history[newerFrame % HistoryFrames];
+
+  outPose.Location = FMath::Lerp(older.Location, newer.Location, static_cast<double>(alpha));
+  outPose.Rotation = FQuat(FQuat4f::Slerp(older.Rotation, newer.Rotation, alpha));
+  outPose.CapsuleRadius = FMath::Lerp(older.CapsuleRadius, newer.CapsuleRadius, alpha);
+  outPose.CapsuleHalfHeight = FMath::Lerp(older.CapsuleHalfHeight, newer.CapsuleHalfHeight, alpha);
+}
+
+bool ULagCompensationSubsystem::RewindCharacter(const ACharacter* character, double serverTime, FLagCompensationPose& outPose) const
+{
+  SCOPE_CYCLE_COUNTER(STAT_LagCompensationRewind);
+
+  const int32* slotIndex = SlotIndices.Find(character);
+  if (!slotIndex || !Slots[*slotIndex].Character.IsValid()) return false;
+
+  InterpolatePose(*slotIndex, serverTime, outPose);
+  return true;
+}
+
+void ULagCompensationSubsystem::RewindAllCharacters(double serverTime, TArray<FLagCompensationPose>& outPoses) const
+{
+  SCOPE_CYCLE_COUNTER(STAT_LagCompensationRewind);
+
+  outPoses.Reset(SlotIndices.Num());
+  for (int32 slotIndex = 0; slotIndex < Slots.Num(); ++slotIndex)
+  {
+    if (Slots[slotIndex].Character.IsValid())
+    {
+      InterpolatePose(slotIndex, serverTime, outPoses.AddDefaulted_GetRef());
+    }
+  }
+}
+
+double ULagCompensationSubsystem::GetClientViewTime(const APlayerController* playerController) const
+{
+  const double now = GetWorld()->GetTimeSeconds();
+  const APlayerState* playerState = playerController ? playerController->PlayerState : nullptr;
+  if (!playerState || playerController->IsLocalController()) return now;
+
+  const double oneWaySeconds = playerState->GetPingInMilliseconds() * 0.0005;
+  return now - FMath::Min(oneWaySeconds + InterpolationDelaySeconds, static_cast<double>(MaxRewindSeconds));
+}
+
+bool ULagCompensationSubsystem::ConfirmHit(const ACharacter* target, double serverTime, const FVector& traceStart, const FVector& traceEnd, float toleranceCm) const
+{
+  FLagCompensationPose pose;
+  if (!RewindCharacter(target, serverTime, pose)) return false;
+
+  // the capsule is the segment between the centers of its hemispheres inflated by the radius
+  const FVector axis = pose.Rotation.GetUpVector() * FMath::Max(pose.CapsuleHalfHeight - pose.CapsuleRadius, 0.0f);
+  FVector pointOnTrace;
+  FVector pointOnCapsule;
+  FMath::SegmentDistToSegmentSafe(traceStart, traceEnd, pose.Location - axis, pose.Location + axis, pointOnTrace, pointOnCapsule);
+
+  return FVector::DistSquared(pointOnTrace, pointOnCapsule) <= FMath::Square(pose.CapsuleRadius + toleranceCm);
+}
+
+void ULagCompensationSubsystem::StartRewindBenchmark(int32 numCharacters, int32 numQueries)
+{
+  if (BenchmarkTickerHandle.IsValid() || GetWorld()->GetNetMode() == NM_Client) return;
+
+  UNetBenchmarkSubsystem* benchmark = GetWorld()->GetGameInstance()->GetSubsystem<UNetBenchmarkSubsystem>();
+  if (benchmark && numCharacters > SlotIndices.Num())
+  {
+    benchmark->SpawnBenchmarkCharacters(numCharacters - SlotIndices.Num());
+  }
+
+  BenchmarkStartFrame = NextFrame;
+  BenchmarkQueries = FMath::Max(numQueries, 1);
+  BenchmarkTickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &ThisClass::TickRewindBenchmark));
+}
+
+bool ULagCompensationSubsystem::TickRewindBenchmark(float deltaTime)
+{
+  // wait until every character has a full history
+  if (NextFrame < BenchmarkStartFrame + HistoryFrames) return true;
+
+  BenchmarkTickerHandle.Reset();
+
+  const double newestTime = GetFrameTime(NextFrame - 1);
+  const double oldestTime = GetFrameTime(NextFrame - HistoryFrames);
+  FRandomStream random(1234);
+
+  TArray<FLagCompensationPose> poses;
+  const double rewindAllStart = FPlatformTime::Seconds();
+  for (int32 query = 0; query < BenchmarkQueries; ++query)
+  {
+    RewindAllCharacters(random.FRandRange(oldestTime, newestTime), poses);
+  }
+  const double rewindAllSeconds = FPlatformTime::Seconds() - rewindAllStart;
+
+  int32 hits = 0;
+  const double confirmHitStart = FPlatformTime::Seconds();
+  for (int32 query = 0; query < BenchmarkQueries && poses.Num() > 0; ++query)
+  {
+    const FLagCompensationPose& target = poses[query % poses.Num()];
+    const FVector traceStart = target.Location + FVector(1000.0f, 0.0f, 0.0f);
+    hits += ConfirmHit(target.Character, random.FRandRange(oldestTime, newestTime), traceStart, target.Location) ? 1 : 0;
+  }
+  const double confirmHitSeconds = FPlatformTime::Seconds() - confirmHitStart;
+
+  FNetBenchmarkReport report(TEXT("LagCompensation"));
+  TSharedRef<FJsonObject> result = report.AddResult();
+  result->SetNumberField(TEXT("characters"), poses.Num());
+  result->SetNumberField(TEXT("historyFrames"), HistoryFrames);
+  result->SetNumberField(TEXT("historySeconds"), newestTime - oldestTime);
+  result->SetNumberField(TEXT("historyBytes"), static_cast<double>(GetHistoryBytes()));
+  result->SetNumberField(TEXT("queries"), BenchmarkQueries);
+  result->SetNumberField(TEXT("rewindAllUs"), rewindAllSeconds * 1000000.0 / BenchmarkQueries);
+  result->SetNumberField(TEXT("confirmHitUs"), confirmHitSeconds * 1000000.0 / BenchmarkQueries);
+  result->SetNumberField(TEXT("confirmedHits"), hits);
+  report.Save();
+
+  UE_LOG(LogLagCompensation, Display, TEXT("%d characters, %d frames (%d KB): rewind all %.2f us, confirm hit %.2f us per query"),
+    poses.Num(), HistoryFrames, static_cast<int32>(GetHistoryBytes() / 1024), rewindAllSeconds * 1000000.0 / BenchmarkQueries, confirmHitSeconds * 1000000.0 / BenchmarkQueries);
+
+  if (UNetBenchmarkSubsystem* benchmark = GetWorld()->GetGameInstance()->GetSubsystem<UNetBenchmarkSubsystem>())
+  {
+    benchmark->DestroyBenchmarkCharacters();
+  }
+  return false;
+}
@@ -5,11 +5,32 @@
 #include "GameFramework/GameStateBase.h"
 #include "GameFramework/PlayerState.h"
 #include "../DebugHelper.h"
+#include "JoinAdmissionComponent.h"
+#include "NetBandwidthGovernorComponent.h"
+
+ALobbyGameMode::ALobbyGameMode()
+{
+  BandwidthGovernor = CreateDefaultSubobject<UNetBandwidthGovernorComponent>(TEXT("BandwidthGovernor"));
+  JoinAdmission = CreateDefaultSubobject<UJoinAdmissionComponent>(TEXT("JoinAdmission"));
+}
+
+void ALobbyGameMode::PreLogin(const FString& Options, const FString& Address, const FUniqueNetIdRepl& UniqueId, FString& ErrorMessage)
+{
+  Super::PreLogin(Options, Address, UniqueId, ErrorMessage);
+
+  // a rejected join costs the host nothing beyond the handshake
+  if (ErrorMessage.IsEmpty())
+  {
+    ErrorMessage = JoinAdmission->AdmitPlayer(UniqueId, Address);
+  }
+}
 
 void ALobbyGameMode::PostLogin(APlayerController* newplayer)
 {
   Super::PostLogin(newplayer);
 
+  JoinAdmission->OnPlayerLoggedIn(newplayer);
+
   if (GameState)
   {
     int32  numOfPlayers = GameState.Get()->PlayerArray.Num();
@@ -22,12 +43,16 @@ void ALobbyGameMode::PostLogin(APlayerController* newplayer)
       Debug::Print(playerName + " has joined the game.", FColor::Cyan, 60.0f, -1);
     }
   }
+
+  BandwidthGovernor->Rebalance();
 }
 
 void ALobbyGameMode::Logout(AController* exiting)
 {
   Super::Logout(exiting);
 
+  BandwidthGovernor->Rebalance(exiting);
+
   APlayerState* playerState = exiting->GetPlayerState<APlayerState>();
   if (playerState)
   {
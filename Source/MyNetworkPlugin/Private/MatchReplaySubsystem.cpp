@@ -0,0 +1,175 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MatchReplaySubsystem.h"
+#include "NetBenchmarkSubsystem.h"
+#include "Engine/DemoNetDriver.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/PackageName.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogMatchReplay, Log, All);
+
+// Replays go through the compressing local file streamer instead of the default one
+static const TCHAR* CompressedStreamerOption = TEXT("ReplayStreamerOverride=CompressedReplayStreaming");
+
+static UMatchReplaySubsystem* GetMatchReplaySubsystem(UWorld* world)
+{
+  UGameInstance* gameInstance = world ? world->GetGameInstance() : nullptr;
+  return gameInstance ? gameInstance->GetSubsystem<UMatchReplaySubsystem>() : nullptr;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs MatchReplayRecordCommand(
+  TEXT("MatchReplay.Record"),
+  TEXT("MatchReplay.Record <0|1>: turns recording of the lobby and gameplay maps off or on, takes effect on the next map"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      if (UMatchReplaySubsystem* replays = GetMatchReplaySubsystem(world))
+      {
+        replays->SetRecordingEnabled(args.Num() > 0 && FCString::Atoi(*args[0]) != 0);
+      }
+    }));
+
+static FAutoConsoleCommandWithWorldAndArgs MatchReplayPlayCommand(
+  TEXT("MatchReplay.Play"),
+  TEXT("MatchReplay.Play <Name>: plays a recorded match replay"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UMatchReplaySubsystem* replays = GetMatchReplaySubsystem(world);
+      if (replays && args.Num() > 0)
+      {
+        replays->PlayReplay(args[0]);
+      }
+    }));
+
+static FAutoConsoleCommandWithWorldAndArgs MatchReplayScrubCommand(
+  TEXT("MatchReplay.Scrub"),
+  TEXT("MatchReplay.Scrub <Seconds>: jumps to the given time of the replay being played"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UMatchReplaySubsystem* replays = GetMatchReplaySubsystem(world);
+      if (replays && args.Num() > 0)
+      {
+        replays->ScrubReplay(FCString::Atof(*args[0]));
+      }
+    }));
+
+static FAutoConsoleCommandWithWorldAndArgs NetBenchReplayOverheadCommand(
+  TEXT("NetBench.ReplayOverhead"),
+  TEXT("NetBench.ReplayOverhead [NumCharacters] [SecondsPerPhase]: server tick time with and without match recording, run on the host"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UMatchReplaySubsystem* replays = GetMatchReplaySubsystem(world);
+      UNetBenchmarkSubsystem* benchmark = world && world->GetGameInstance() ? world->GetGameInstance()->GetSubsystem<UNetBenchmarkSubsystem>() : nullptr;
+      if (!replays || !benchmark) return;
+
+      const int32 numCharacters = args.IsValidIndex(0) ? FCString::Atoi(*args[0]) : 16;
+      const float seconds = args.IsValidIndex(1) ? FCString::Atof(*args[1]) : 10.0f;
+
+      TArray<FServerTickBenchmarkPhase> phases;
+      phases.Add({ TEXT("NotRecording") });
+
+      FServerTickBenchmarkPhase& recording = phases.AddDefaulted_GetRef();
+      recording.Name = TEXT("Recording");
+      recording.Begin = [replays]() { replays->StartRecording(TEXT("ReplayOverheadBenchmark")); };
+      recording.End = [replays]() { replays->StopRecording(); };
+
+      benchmark->StartServerTickBenchmark(TEXT("ReplayOverhead"), numCharacters, seconds, MoveTemp(phases));
+    }));
+
+void UMatchReplaySubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+  Super::Initialize(Collection);
+
+  PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddUObject(this, &ThisClass::OnPostLoadMap);
+  PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddUObject(this, &ThisClass::OnPreLoadMap);
+}
+
+void UMatchReplaySubsystem::Deinitialize()
+{
+  FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+  FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+
+  Super::Deinitialize();
+}
+
+void UMatchReplaySubsystem::SetRecordingEnabled(bool bEnabled)
+{
+  bRecordMatches = bEnabled;
+}
+
+void UMatchReplaySubsystem::StartRecording(const FString& replayName)
+{
+  ApplyRecordingBudget();
+
+  GetGameInstance()->StartRecordingReplay(replayName, replayName, { CompressedStreamerOption });
+  UE_LOG(LogMatchReplay, Display, TEXT("Recording replay %s"), *replayName);
+}
+
+void UMatchReplaySubsystem::StopRecording()
+{
+  if (IsRecording())
+  {
+    GetGameInstance()->StopRecordingReplay();
+  }
+}
+
+bool UMatchReplaySubsystem::IsRecording() const
+{
+  const UWorld* world = GetGameInstance()->GetWorld();
+  const UDemoNetDriver* demoNetDriver = world ? world->GetDemoNetDriver() : nullptr;
+  return demoNetDriver && demoNetDriver->IsRecording();
+}
+
+bool UMatchReplaySubsystem::PlayReplay(const FString& replayName)
+{
+  return GetGameInstance()->PlayReplay(replayName, nullptr, { CompressedStreamerOption });
+}
+
+void UMatchReplaySubsystem::ScrubReplay(float timeInSeconds)
+{
+  UWorld* world = GetGameInstance()->GetWorld();
+  UDemoNetDriver* demoNetDriver = world ? world->GetDemoNetDriver() : nullptr;
+  if (demoNetDriver && demoNetDriver->IsPlaying())
+  {
+    demoNetDriver->GotoTimeInSeconds(timeInSeconds);
+  }
+}
+
+void UMatchReplaySubsystem::OnPostLoadMap(UWorld* world)
+{
+  if (!bRecordMatches || !world || world->GetGameInstance() != GetGameInstance()) return;
+
+  const ENetMode netMode = world->GetNetMode();
+  if (netMode != NM_ListenServer && netMode != NM_DedicatedServer) return;
+
+  const FString mapName = UWorld::RemovePIEPrefix(world->GetOutermost()->GetName());
+  if (!RecordedMaps.Contains(mapName)) return;
+
+  StartRecording(FString::Printf(TEXT("%s-%s"), *FPackageName::GetShortName(mapName), *FDateTime::Now().ToString()));
+}
+
+void UMatchReplaySubsystem::OnPreLoadMap(const FString& mapName)
+{
+  // every map gets its own replay
+  StopRecording();
+}
+
+void UMatchReplaySubsystem::ApplyRecordingBudget() const
+{
+  auto setDemoVariable = [](const TCHAR* name, float value)
+    {
+      if (IConsoleVariable* variable = IConsoleManager::Get().FindConsoleVariable(name))
+      {
+        variable->Set(value, ECVF_SetByCode);
+      }
+    };
+
+  setDemoVariable(TEXT("demo.RecordHz"), RecordHz);
+  setDemoVariable(TEXT("demo.MaxDesiredRecordTimeMS"), MaxRecordTimeMSPerFrame);
+  setDemoVariable(TEXT("demo.CheckpointSaveMaxMSPerFrameOverride"), MaxCheckpointSaveMSPerFrame);
+  setDemoVariable(TEXT("demo.CheckpointUploadDelayInSeconds"), CheckpointIntervalSeconds);
+}
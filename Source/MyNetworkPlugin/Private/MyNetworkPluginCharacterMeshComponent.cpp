@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MyNetworkPluginCharacterMeshComponent.h"
+#include "HAL/PlatformTime.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Stats/Stats.h"
+
+DECLARE_STATS_GROUP(TEXT("CharacterCost"), STATGROUP_CharacterCost, STATCAT_Advanced);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Mesh Tick (ms)"), STAT_CharacterCostMeshTick, STATGROUP_CharacterCost);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Meshes Ticking Pose"), STAT_CharacterCostMeshesTickingPose, STATGROUP_CharacterCost);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Meshes Not Ticking Pose"), STAT_CharacterCostMeshesNotTickingPose, STATGROUP_CharacterCost);
+
+CSV_DEFINE_CATEGORY(CharacterCost, true);
+
+void UMyNetworkPluginCharacterMeshComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+  const uint64 startCycles = FPlatformTime::Cycles64();
+
+  Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+  TickCost.Add(FPlatformTime::Cycles64() - startCycles);
+
+  INC_FLOAT_STAT_BY(STAT_CharacterCostMeshTick, TickCost.LastMs);
+  if (ShouldTickPose())
+  {
+    INC_DWORD_STAT(STAT_CharacterCostMeshesTickingPose);
+  }
+  else
+  {
+    INC_DWORD_STAT(STAT_CharacterCostMeshesNotTickingPose);
+  }
+  CSV_CUSTOM_STAT(CharacterCost, MeshTickMs, TickCost.LastMs, ECsvCustomStatOp::Accumulate);
+}
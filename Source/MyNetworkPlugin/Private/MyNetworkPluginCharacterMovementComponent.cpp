@@ -0,0 +1,359 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MyNetworkPluginCharacterMovementComponent.h"
+#include "EngineUtils.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PlayerState.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "HAL/PlatformTime.h"
+#include "Stats/Stats.h"
+#include "UObject/ObjectKey.h"
+
+DECLARE_STATS_GROUP(TEXT("NetMovement"), STATGROUP_NetMovement, STATCAT_Advanced);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Corrections"), STAT_NetMovementCorrections, STATGROUP_NetMovement);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Correction Error (cm)"), STAT_NetMovementCorrectionError, STATGROUP_NetMovement);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Jitter Buffer Underruns"), STAT_NetMovementJitterBufferUnderruns, STATGROUP_NetMovement);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Arrival Jitter (ms)"), STAT_NetMovementArrivalJitter, STATGROUP_NetMovement);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Movement Tick (ms)"), STAT_NetMovementTick, STATGROUP_NetMovement);
+
+CSV_DEFINE_CATEGORY(NetMovement, true);
+
+DEFINE_LOG_CATEGORY_STATIC(LogNetMovement, Log, All);
+
+static int32 GProxyJitterBuffer = 1;
+static FAutoConsoleVariableRef CVarProxyJitterBuffer(
+  TEXT("net.ProxyJitterBuffer"),
+  GProxyJitterBuffer,
+  TEXT("1: simulated proxies draw their mesh from a buffer of the movement updates stamped with their server time, 0: the engine smoothing follows the latest update"));
+
+// a few seconds of updates at the usual net update frequencies
+static constexpr int32 MaxMovementSnapshots = 32;
+
+static FAutoConsoleCommandWithWorld NetMovementCorrectionsCommand(
+  TEXT("Net.MovementCorrections"),
+  TEXT("Prints the server corrections of every character: count, error magnitude and time since the last one"),
+  FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+    {
+      if (!world) return;
+
+      for (TActorIterator<ACharacter> it(world); it; ++it)
+      {
+        const UMyNetworkPluginCharacterMovementComponent* movement = Cast<UMyNetworkPluginCharacterMovementComponent>(it->GetCharacterMovement());
+        if (!movement) continue;
+
+        const FMovementCorrectionStats& stats = movement->GetCorrectionStats();
+        const APlayerState* playerState = it->GetPlayerState();
+        UE_LOG(LogNetMovement, Display, TEXT("%s: %d corrections, error avg %.1f max %.1f last %.1f cm, %.1f s since last"),
+          playerState ? *playerState->GetPlayerName() : *it->GetName(),
+          stats.Count, stats.GetAverageErrorCm(), stats.MaxErrorCm, stats.LastErrorCm, movement->GetSecondsSinceLastCorrection());
+      }
+    }));
+
+static FAutoConsoleCommandWithWorld NetJitterBufferCommand(
+  TEXT("Net.JitterBuffer"),
+  TEXT("Prints the interpolation buffer of every simulated proxy: arrival jitter, update interval, playout delay, depth and underruns"),
+  FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+    {
+      if (!world) return;
+
+      for (TActorIterator<ACharacter> it(world); it; ++it)
+      {
+        const UMyNetworkPluginCharacterMovementComponent* movement = Cast<UMyNetworkPluginCharacterMovementComponent>(it->GetCharacterMovement());
+        if (!movement || it->GetLocalRole() != ROLE_SimulatedProxy) continue;
+
+        const FJitterBufferStats& stats = movement->GetJitterBufferStats();
+        const APlayerState* playerState = it->GetPlayerState();
+        UE_LOG(LogNetMovement, Display, TEXT("%s: jitter %.1f ms, interval %.1f ms, playout delay %.1f ms, depth %d updates %.1f ms, %d underruns"),
+          playerState ? *playerState->GetPlayerName() : *it->GetName(),
+          stats.ArrivalJitterMs, stats.AverageIntervalMs, stats.PlayoutDelayMs, stats.Depth, stats.DepthMs, stats.Underruns);
+      }
+    }));
+
+// Timing of the movement updates of all simulated proxies received over one connection, in seconds
+struct FConnectionArrivalTiming
+{
+  // RFC 3550 interarrival jitter
+  double Jitter = 0.0;
+  // local arrival time minus server time of the updates, smoothed, maps the local clock onto the server one
+  double ClockOffset = 0.0;
+  bool bHasClockOffset = false;
+};
+
+static FConnectionArrivalTiming& GetConnectionArrivalTiming(const UNetConnection* connection)
+{
+  static TMap<TObjectKey<UNetConnection>, FConnectionArrivalTiming> connectionArrivalTiming;
+
+  // clients rarely have more than one connection, forget the closed ones as new ones show up
+  if (!connectionArrivalTiming.Contains(connection))
+  {
+    for (auto it = connectionArrivalTiming.CreateIterator(); it; ++it)
+    {
+      if (!it->Key.ResolveObjectPtr())
+      {
+        it.RemoveCurrent();
+      }
+    }
+  }
+  return connectionArrivalTiming.FindOrAdd(connection);
+}
+
+void FMovementCorrectionStats::AddCorrection(float errorCm, double worldTime)
+{
+  ++Count;
+  LastErrorCm = errorCm;
+  MaxErrorCm = FMath::Max(MaxErrorCm, errorCm);
+  TotalErrorCm += errorCm;
+  LastCorrectionTime = worldTime;
+
+  INC_DWORD_STAT(STAT_NetMovementCorrections);
+  INC_FLOAT_STAT_BY(STAT_NetMovementCorrectionError, errorCm);
+  CSV_CUSTOM_STAT(NetMovement, Corrections, 1, ECsvCustomStatOp::Accumulate);
+  CSV_CUSTOM_STAT(NetMovement, MaxCorrectionErrorCm, errorCm, ECsvCustomStatOp::Max);
+}
+
+UMyNetworkPluginCharacterMovementComponent::UMyNetworkPluginCharacterMovementComponent()
+{
+  // the server stamps every movement update with its time, not only for linear smoothing, the jitter buffer orders
+  // the updates of simulated proxies by it
+  bNetworkAlwaysReplicateTransformUpdateTimestamp = true;
+}
+
+FCharacterNetMovementCounters& UMyNetworkPluginCharacterMovementComponent::GetNetMovementCounters()
+{
+  static FCharacterNetMovementCounters counters;
+  return counters;
+}
+
+void UMyNetworkPluginCharacterMovementComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+  const uint64 startCycles = FPlatformTime::Cycles64();
+
+  Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+  TickCost.Add(FPlatformTime::Cycles64() - startCycles);
+  INC_FLOAT_STAT_BY(STAT_NetMovementTick, TickCost.LastMs);
+  CSV_CUSTOM_STAT(NetMovement, MovementTickMs, TickCost.LastMs, ECsvCustomStatOp::Accumulate);
+}
+
+double UMyNetworkPluginCharacterMovementComponent::GetSecondsSinceLastCorrection() const
+{
+  const UWorld* world = GetWorld();
+  if (!world || CorrectionStats.LastCorrectionTime < 0.0) return -1.0;
+
+  return world->GetTimeSeconds() - CorrectionStats.LastCorrectionTime;
+}
+
+void UMyNetworkPluginCharacterMovementComponent::CallServerMovePacked(const FSavedMove_Character* NewMove, const FSavedMove_Character* PendingMove, const FSavedMove_Character* OldMove)
+{
+  ++GetNetMovementCounters().ServerMovesSent;
+
+  Super::CallServerMovePacked(NewMove, PendingMove, OldMove);
+}
+
+void UMyNetworkPluginCharacterMovementComponent::ServerMovePacked_ServerReceive(const FCharacterServerMovePackedBits& PackedBits)
+{
+  ++GetNetMovementCounters().ServerMovesReceived;
+
+  Super::ServerMovePacked_ServerReceive(PackedBits);
+}
+
+bool UMyNetworkPluginCharacterMovementComponent::ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode)
+{
+  const bool bHasError = Super::ServerCheckClientError(ClientTimeStamp, DeltaTime, Accel, ClientWorldLocation, RelativeClientLocation, ClientMovementBase, ClientBaseBoneName, ClientMovementMode);
+  PendingClientErrorCm = bHasError && UpdatedComponent ? FVector::Dist(UpdatedComponent->GetComponentLocation(), ClientWorldLocation) : 0.0f;
+
+  return bHasError;
+}
+
+void UMyNetworkPluginCharacterMovementComponent::ServerSendMoveResponse(const FClientAdjustment& PendingAdjustment)
+{
+  if (!PendingAdjustment.bAckGoodMove)
+  {
+    ++GetNetMovementCounters().CorrectionsSent;
+    CorrectionStats.AddCorrection(PendingClientErrorCm, GetWorld()->GetTimeSeconds());
+  }
+  PendingClientErrorCm = 0.0f;
+
+  Super::ServerSendMoveResponse(PendingAdjustment);
+}
+
+void UMyNetworkPluginCharacterMovementComponent::ClientHandleMoveResponse(const FCharacterMoveResponseDataContainer& MoveResponse)
+{
+  if (!MoveResponse.IsGoodMove())
+  {
+    ++GetNetMovementCounters().CorrectionsReceived;
+
+    // the server corrects where the client ended the move at adjustment.TimeStamp, the client has predicted further
+    // since. Based corrections carry a relative location, only the world space ones give a meaningful error.
+    const FClientAdjustment& adjustment = MoveResponse.ClientAdjustment;
+    const FNetworkPredictionData_Client_Character* clientData = !adjustment.NewBase && HasPredictionData_Client() ? GetPredictionData_Client_Character() : nullptr;
+    const int32 moveIndex = clientData ? clientData->GetSavedMoveIndex(adjustment.TimeStamp) : INDEX_NONE;
+    const float errorCm = moveIndex != INDEX_NONE ? FVector::Dist(clientData->SavedMoves[moveIndex]->SavedLocation, adjustment.NewLoc) : 0.0f;
+    CorrectionStats.AddCorrection(errorCm, GetWorld()->GetTimeSeconds());
+  }
+
+  Super::ClientHandleMoveResponse(MoveResponse);
+}
+
+void UMyNetworkPluginCharacterMovementComponent::SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation, const FVector& NewLocation, const FQuat& NewRotation)
+{
+  if (!UsesJitterBuffer() || !HasValidData())
+  {
+    Super::SmoothCorrection(OldLocation, OldRotation, NewLocation, NewRotation);
+    return;
+  }
+
+  // a teleport is not interpolated to
+  if (FVector::DistSquared(OldLocation, NewLocation) > FMath::Square(NetworkNoSmoothUpdateDistance))
+  {
+    MovementSnapshots.Reset();
+  }
+  AddMovementSnapshot(NewLocation, NewRotation);
+  bNetworkSmoothingComplete = false;
+}
+
+void UMyNetworkPluginCharacterMovementComponent::SmoothClientPosition(float DeltaSeconds)
+{
+  if (!UsesJitterBuffer() || !PlayMovementSnapshots())
+  {
+    Super::SmoothClientPosition(DeltaSeconds);
+  }
+}
+
+bool UMyNetworkPluginCharacterMovementComponent::UsesJitterBuffer() const
+{
+  const UNetDriver* netDriver = GetWorld() ? GetWorld()->GetNetDriver() : nullptr;
+  return GProxyJitterBuffer != 0 && CharacterOwner && CharacterOwner->GetLocalRole() == ROLE_SimulatedProxy
+    && NetworkSmoothingMode != ENetworkSmoothingMode::Disabled && netDriver && netDriver->ServerConnection;
+}
+
+void UMyNetworkPluginCharacterMovementComponent::AddMovementSnapshot(const FVector& location, const FQuat& rotation)
+{
+  const double arrivalTime = FPlatformTime::Seconds();
+  const double serverTime = CharacterOwner->GetReplicatedServerLastTransformUpdateTimeStamp();
+
+  // the same update applied again, e.g. when the movement base replicates after it
+  if (MovementSnapshots.Num() > 0 && serverTime <= MovementSnapshots.Last().ServerTime)
+  {
+    MovementSnapshots.Last().Location = location;
+    MovementSnapshots.Last().Rotation = rotation;
+    return;
+  }
+
+  FConnectionArrivalTiming& timing = GetConnectionArrivalTiming(GetWorld()->GetNetDriver()->ServerConnection);
+  if (MovementSnapshots.Num() > 0)
+  {
+    // RFC 3550 interarrival jitter: the change in transit time between two updates, smoothed by 1/16
+    const FProxyMovementSnapshot previous = MovementSnapshots.Last();
+    const double arrivalInterval = arrivalTime - LastArrivalTime;
+    const double sendInterval = serverTime - previous.ServerTime;
+    timing.Jitter += (FMath::Abs(arrivalInterval - sendInterval) - timing.Jitter) / 16.0;
+
+    if (sendInterval < 0.5)
+    {
+      AverageIntervalSeconds = AverageIntervalSeconds > 0.0 ? FMath::Lerp(AverageIntervalSeconds, sendInterval, 0.1) : sendInterval;
+    }
+    else
+    {
+      // idle characters are not replicated, it stood at the previous update until shortly before this one
+      FProxyMovementSnapshot& restSnapshot = MovementSnapshots.Add_GetRef(previous);
+      restSnapshot.ServerTime = serverTime - FMath::Clamp(AverageIntervalSeconds, 0.01, 0.25);
+      restSnapshot.Velocity = FVector::ZeroVector;
+    }
+  }
+
+  const double transitTime = arrivalTime - serverTime;
+  timing.ClockOffset = timing.bHasClockOffset ? timing.ClockOffset + (transitTime - timing.ClockOffset) / 16.0 : transitTime;
+  timing.bHasClockOffset = true;
+
+  // the next update has to arrive before the playout time reaches this one: an update interval plus the jitter
+  const float targetDelay = FMath::Clamp(static_cast<float>(AverageIntervalSeconds + BasePlayoutDelay + JitterMultiplier * timing.Jitter), MinPlayoutDelay, MaxPlayoutDelay);
+  PlayoutDelay = targetDelay > PlayoutDelay ? targetDelay : FMath::Lerp(PlayoutDelay, targetDelay, PlayoutDelayDecay);
+
+  FProxyMovementSnapshot& snapshot = MovementSnapshots.AddDefaulted_GetRef();
+  snapshot.ServerTime = serverTime;
+  snapshot.Location = location;
+  snapshot.Rotation = rotation;
+  snapshot.Velocity = Velocity;
+  if (MovementSnapshots.Num() > MaxMovementSnapshots)
+  {
+    MovementSnapshots.RemoveAt(0, MovementSnapshots.Num() - MaxMovementSnapshots, EAllowShrinking::No);
+  }
+  LastArrivalTime = arrivalTime;
+
+  JitterBufferStats.ArrivalJitterMs = static_cast<float>(timing.Jitter * 1000.0);
+  JitterBufferStats.AverageIntervalMs = static_cast<float>(AverageIntervalSeconds * 1000.0);
+  JitterBufferStats.PlayoutDelayMs = PlayoutDelay * 1000.0f;
+  SET_FLOAT_STAT(STAT_NetMovementArrivalJitter, JitterBufferStats.ArrivalJitterMs);
+  CSV_CUSTOM_STAT(NetMovement, JitterBufferPlayoutDelayMs, JitterBufferStats.PlayoutDelayMs, ECsvCustomStatOp::Max);
+}
+
+bool UMyNetworkPluginCharacterMovementComponent::PlayMovementSnapshots()
+{
+  USkeletalMeshComponent* mesh = CharacterOwner->GetMesh();
+  if (MovementSnapshots.Num() == 0 || !UpdatedComponent || !mesh || mesh->GetAttachParent() != UpdatedComponent) return false;
+
+  const FConnectionArrivalTiming& timing = GetConnectionArrivalTiming(GetWorld()->GetNetDriver()->ServerConnection);
+  const double playoutTime = FPlatformTime::Seconds() - timing.ClockOffset - PlayoutDelay;
+
+  // the updates before the latest one at or before the playout time are played
+  int32 numPlayed = 0;
+  while (numPlayed + 1 < MovementSnapshots.Num() && MovementSnapshots[numPlayed + 1].ServerTime <= playoutTime)
+  {
+    ++numPlayed;
+  }
+  MovementSnapshots.RemoveAt(0, numPlayed, EAllowShrinking::No);
+
+  const FProxyMovementSnapshot& from = MovementSnapshots[0];
+  FVector location = from.Location;
+  FQuat rotation = from.Rotation;
+  bool bIdle = false;
+  if (MovementSnapshots.Num() > 1 && playoutTime >= from.ServerTime)
+  {
+    const FProxyMovementSnapshot& to = MovementSnapshots[1];
+    const float alpha = static_cast<float>((playoutTime - from.ServerTime) / (to.ServerTime - from.ServerTime));
+    location = FMath::Lerp(from.Location, to.Location, alpha);
+    rotation = FQuat::Slerp(from.Rotation, to.Rotation, alpha);
+    bUnderrun = false;
+  }
+  else if (MovementSnapshots.Num() == 1 && playoutTime >= from.ServerTime)
+  {
+    // a character standing still gets no updates, that is no underrun
+    bIdle = from.Velocity.IsNearlyZero();
+    if (!bIdle)
+    {
+      if (!bUnderrun)
+      {
+        bUnderrun = true;
+        ++JitterBufferStats.Underruns;
+        PlayoutDelay = FMath::Min(PlayoutDelay + UnderrunBackOff, MaxPlayoutDelay);
+        JitterBufferStats.PlayoutDelayMs = PlayoutDelay * 1000.0f;
+
+        INC_DWORD_STAT(STAT_NetMovementJitterBufferUnderruns);
+        CSV_CUSTOM_STAT(NetMovement, JitterBufferUnderruns, 1, ECsvCustomStatOp::Accumulate);
+      }
+      location += from.Velocity * FMath::Min(static_cast<float>(playoutTime - from.ServerTime), MaxExtrapolationTime);
+    }
+  }
+
+  JitterBufferStats.Depth = playoutTime >= from.ServerTime ? MovementSnapshots.Num() - 1 : MovementSnapshots.Num();
+  JitterBufferStats.DepthMs = static_cast<float>(FMath::Max(MovementSnapshots.Last().ServerTime - playoutTime, 0.0) * 1000.0);
+  if (!bIdle)
+  {
+    CSV_CUSTOM_STAT(NetMovement, JitterBufferDepth, JitterBufferStats.Depth, ECsvCustomStatOp::Min);
+  }
+
+  // the capsule follows the latest update, the mesh is drawn at the playout time
+  const FTransform meshTransform = FTransform(CharacterOwner->GetBaseRotationOffset(), CharacterOwner->GetBaseTranslationOffset())
+    * FTransform(rotation, location, UpdatedComponent->GetComponentScale());
+  const FTransform relativeTransform = meshTransform.GetRelativeTransform(UpdatedComponent->GetComponentTransform());
+  mesh->SetRelativeLocationAndRotation(relativeTransform.GetLocation(), relativeTransform.GetRotation(), false, nullptr, ETeleportType::TeleportPhysics);
+
+  // nothing left to play until the next update
+  bNetworkSmoothingComplete = bIdle;
+  return true;
+}
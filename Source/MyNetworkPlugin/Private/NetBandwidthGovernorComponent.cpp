@@ -0,0 +1,183 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetBandwidthGovernorComponent.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+CSV_DEFINE_CATEGORY(NetBandwidth, true);
+
+DEFINE_LOG_CATEGORY_STATIC(LogNetBandwidth, Log, All);
+
+static FAutoConsoleCommandWithWorld NetBandwidthGovernorCommand(
+  TEXT("Net.BandwidthGovernor"),
+  TEXT("Prints the budgets of the bandwidth governor and the saturation of every client connection"),
+  FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+    {
+      AGameModeBase* gameMode = world ? world->GetAuthGameMode() : nullptr;
+      const UNetBandwidthGovernorComponent* governor = gameMode ? gameMode->FindComponentByClass<UNetBandwidthGovernorComponent>() : nullptr;
+      if (!governor) return;
+
+      UE_LOG(LogNetBandwidth, Display, TEXT("Budget scale %.2f, client rate %d B/s, pawn net update frequency %.1f Hz"),
+        governor->GetBudgetScale(), governor->GetClientRate(), governor->GetPawnNetUpdateFrequency());
+      for (const FConnectionSaturationStats& stats : governor->GetConnectionStats())
+      {
+        UE_LOG(LogNetBandwidth, Display, TEXT("  %s: net speed %d B/s, out %d B/s, queued %d bits, saturated %.0f%%"),
+          *stats.PlayerName, stats.CurrentNetSpeed, stats.OutBytesPerSecond, stats.QueuedBits, stats.SaturatedRatio * 100.0f);
+      }
+    }));
+
+UNetBandwidthGovernorComponent::UNetBandwidthGovernorComponent()
+{
+  PrimaryComponentTick.bCanEverTick = true;
+  PrimaryComponentTick.bStartWithTickEnabled = true;
+}
+
+void UNetBandwidthGovernorComponent::BeginPlay()
+{
+  Super::BeginPlay();
+
+  SetComponentTickInterval(SampleInterval);
+  Rebalance();
+}
+
+void UNetBandwidthGovernorComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+  Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+  SampleConnections();
+  if (++WindowSamples >= SamplesPerWindow)
+  {
+    WindowSamples = 0;
+    EvaluateWindow();
+  }
+}
+
+void UNetBandwidthGovernorComponent::SampleConnections()
+{
+  for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it)
+  {
+    APlayerController* playerController = it->Get();
+    UNetConnection* connection = playerController ? playerController->GetNetConnection() : nullptr;
+    // the local controller of a listen server has no connection
+    if (!connection || playerController->IsLocalController()) continue;
+
+    FConnectionSaturationStats* stats = ConnectionStats.FindByPredicate([connection](const FConnectionSaturationStats& entry) { return entry.Connection == connection; });
+    if (!stats)
+    {
+      stats = &ConnectionStats.AddDefaulted_GetRef();
+      stats->Connection = connection;
+      stats->PlayerName = playerController->PlayerState ? playerController->PlayerState->GetPlayerName() : playerController->GetName();
+    }
+
+    ++stats->Samples;
+    if (!connection->IsNetReady(false))
+    {
+      ++stats->SaturatedSamples;
+    }
+  }
+}
+
+void UNetBandwidthGovernorComponent::EvaluateWindow()
+{
+  ConnectionStats.RemoveAll([](const FConnectionSaturationStats& stats) { return !stats.Connection.IsValid(); });
+  for (auto it = NegotiatedNetSpeeds.CreateIterator(); it; ++it)
+  {
+    if (!it->Key.ResolveObjectPtr())
+    {
+      it.RemoveCurrent();
+    }
+  }
+
+  int32 saturatedConnections = 0;
+  for (FConnectionSaturationStats& stats : ConnectionStats)
+  {
+    const UNetConnection* connection = stats.Connection.Get();
+    stats.CurrentNetSpeed = connection->CurrentNetSpeed;
+    stats.OutBytesPerSecond = connection->OutBytesPerSecond;
+    stats.QueuedBits = connection->QueuedBits;
+    stats.SaturatedRatio = stats.Samples > 0 ? static_cast<float>(stats.SaturatedSamples) / stats.Samples : 0.0f;
+    stats.SaturatedSamples = 0;
+    stats.Samples = 0;
+
+    if (stats.SaturatedRatio >= SaturatedRatioThreshold)
+    {
+      ++saturatedConnections;
+    }
+  }
+
+  const UNetDriver* netDriver = GetWorld()->GetNetDriver();
+  const bool bHostSaturated = netDriver && static_cast<int32>(netDriver->OutBytesPerSecond) > HostUpstreamBytesPerSecond;
+  const bool bClientsSaturated = ConnectionStats.Num() > 0 && saturatedConnections > SaturatedConnectionShare * ConnectionStats.Num();
+
+  if (bHostSaturated || bClientsSaturated)
+  {
+    BudgetScale = FMath::Max(MinBudgetScale, BudgetScale * BackOffFactor);
+  }
+  else
+  {
+    BudgetScale = FMath::Min(1.0f, BudgetScale + RecoveryStep);
+  }
+
+  // also picks up pawns spawned since the last window
+  Rebalance();
+
+  CSV_CUSTOM_STAT(NetBandwidth, BudgetScale, BudgetScale, ECsvCustomStatOp::Set);
+  CSV_CUSTOM_STAT(NetBandwidth, SaturatedConnections, saturatedConnections, ECsvCustomStatOp::Set);
+  CSV_CUSTOM_STAT(NetBandwidth, HostOutBytesPerSecond, netDriver ? static_cast<int32>(netDriver->OutBytesPerSecond) : 0, ECsvCustomStatOp::Set);
+}
+
+void UNetBandwidthGovernorComponent::Rebalance(const AController* exiting)
+{
+  UWorld* world = GetWorld();
+  if (!world) return;
+
+  int32 numPlayers = 0;
+  int32 numClients = 0;
+  for (FConstPlayerControllerIterator it = world->GetPlayerControllerIterator(); it; ++it)
+  {
+    const APlayerController* playerController = it->Get();
+    if (!playerController || playerController == exiting) continue;
+
+    ++numPlayers;
+    if (!playerController->IsLocalController())
+    {
+      ++numClients;
+    }
+  }
+
+  const float scaledUpstream = HostUpstreamBytesPerSecond * BudgetScale;
+  ClientRate = FMath::Clamp(FMath::FloorToInt(scaledUpstream / FMath::Max(numClients, 1)), MinClientRate, MaxClientRate);
+
+  const float playerCountScale = static_cast<float>(FullRatePlayerCount) / FMath::Max(numPlayers, FullRatePlayerCount);
+  PawnNetUpdateFrequency = FMath::Clamp(MaxPawnNetUpdateFrequency * playerCountScale * BudgetScale, MinPawnNetUpdateFrequency, MaxPawnNetUpdateFrequency);
+
+  for (FConstPlayerControllerIterator it = world->GetPlayerControllerIterator(); it; ++it)
+  {
+    APlayerController* playerController = it->Get();
+    if (!playerController || playerController == exiting) continue;
+
+    if (UNetConnection* connection = playerController->GetNetConnection())
+    {
+      if (!playerController->IsLocalController())
+      {
+        // a share above what the client asked for would flood its downstream
+        const int32 negotiatedNetSpeed = NegotiatedNetSpeeds.FindOrAdd(connection, connection->CurrentNetSpeed);
+        connection->CurrentNetSpeed = FMath::Min(ClientRate, negotiatedNetSpeed);
+      }
+    }
+    if (APawn* pawn = playerController->GetPawn())
+    {
+      pawn->NetUpdateFrequency = PawnNetUpdateFrequency;
+    }
+  }
+
+  CSV_CUSTOM_STAT(NetBandwidth, ClientRate, ClientRate, ECsvCustomStatOp::Set);
+  CSV_CUSTOM_STAT(NetBandwidth, PawnNetUpdateFrequency, PawnNetUpdateFrequency, ECsvCustomStatOp::Set);
+}
@@ -0,0 +1,458 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetBenchmarkSubsystem.h"
+#include "MyNetworkPluginCharacterMovementComponent.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerStart.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/DateTime.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogNetBenchmark, Log, All);
+
+//////////////////////////////////////////////////////////////////////////
+// FNetBenchmarkReport
+
+FNetBenchmarkReport::FNetBenchmarkReport(const FString& InName) :
+  Name(InName),
+  Root(MakeShared<FJsonObject>())
+{
+  Root->SetStringField(TEXT("benchmark"), Name);
+  Root->SetStringField(TEXT("buildVersion"), FApp::GetBuildVersion());
+  Root->SetStringField(TEXT("engineVersion"), FEngineVersion::Current().ToString());
+  Root->SetStringField(TEXT("buildConfiguration"), LexToString(FApp::GetBuildConfiguration()));
+  Root->SetStringField(TEXT("platform"), FPlatformProperties::IniPlatformName());
+  Root->SetStringField(TEXT("timestamp"), FDateTime::UtcNow().ToIso8601());
+}
+
+TSharedRef<FJsonObject> FNetBenchmarkReport::AddResult()
+{
+  TSharedRef<FJsonObject> result = MakeShared<FJsonObject>();
+  Results.Add(MakeShared<FJsonValueObject>(result));
+  return result;
+}
+
+FString FNetBenchmarkReport::Save() const
+{
+  Root->SetArrayField(TEXT("results"), Results);
+
+  FString output;
+  TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&output);
+  if (!FJsonSerializer::Serialize(Root, writer)) return FString();
+
+  const FString directory = FPaths::ProjectSavedDir() / TEXT("Benchmarks");
+  IFileManager::Get().MakeDirectory(*directory, true);
+
+  const FString path = directory / FString::Printf(TEXT("%s-%s.json"), *Name, *FDateTime::Now().ToString());
+  if (!FFileHelper::SaveStringToFile(output, *path)) return FString();
+
+  UE_LOG(LogNetBenchmark, Display, TEXT("Benchmark report written to %s"), *path);
+  return path;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UNetBenchmarkSubsystem
+
+static FAutoConsoleCommandWithWorldAndArgs NetBenchJoinCommand(
+  TEXT("NetBench.Join"),
+  TEXT("NetBench.Join <Address> [SecondsPerProfile] [Profile...]: joins the host and moves under every emulation profile, all configured ones if none given"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      if (args.Num() < 1 || !world || !world->GetGameInstance()) return;
+
+      UNetBenchmarkSubsystem* benchmark = world->GetGameInstance()->GetSubsystem<UNetBenchmarkSubsystem>();
+      if (!benchmark) return;
+
+      const float seconds = args.IsValidIndex(1) ? FCString::Atof(*args[1]) : 20.0f;
+      TArray<FString> profileNames;
+      for (int32 i = 2; i < args.Num(); ++i)
+      {
+        profileNames.Add(args[i]);
+      }
+      benchmark->StartJoinBenchmark(args[0], seconds, profileNames);
+    }));
+
+void UNetBenchmarkSubsystem::Deinitialize()
+{
+  FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+  if (UWorld* world = ServerWorld.Get())
+  {
+    world->OnTickDispatch().Remove(TickDispatchHandle);
+    world->OnPostTickFlush().Remove(PostTickFlushHandle);
+  }
+  Phase = EBenchmarkPhase::Idle;
+
+  Super::Deinitialize();
+}
+
+void UNetBenchmarkSubsystem::StartJoinBenchmark(const FString& address, float secondsPerProfile, const TArray<FString>& profileNames)
+{
+  if (IsRunning())
+  {
+    UE_LOG(LogNetBenchmark, Warning, TEXT("A benchmark is already running."));
+    return;
+  }
+
+  PendingProfiles.Reset();
+  for (const FNetEmulationProfile& profile : EmulationProfiles)
+  {
+    if (profileNames.Num() == 0 || profileNames.Contains(profile.Name))
+    {
+      PendingProfiles.Add(profile);
+    }
+  }
+  if (PendingProfiles.Num() == 0)
+  {
+    UE_LOG(LogNetBenchmark, Warning, TEXT("No emulation profile to run, check EmulationProfiles in DefaultGame.ini."));
+    return;
+  }
+
+  Address = address;
+  SecondsPerProfile = FMath::Max(secondsPerProfile, 1.0f);
+  Report = MakeUnique<FNetBenchmarkReport>(TEXT("NetEmulation"));
+  Report->Root->SetNumberField(TEXT("secondsPerProfile"), SecondsPerProfile);
+
+  TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &ThisClass::Tick));
+  StartNextProfile();
+}
+
+const FNetEmulationProfile* UNetBenchmarkSubsystem::FindEmulationProfile(const FString& profileName) const
+{
+  return EmulationProfiles.FindByPredicate([&profileName](const FNetEmulationProfile& profile) { return profile.Name == profileName; });
+}
+
+void UNetBenchmarkSubsystem::ApplyEmulationProfile(const FNetEmulationProfile& profile)
+{
+  // The NetEmulation cvars are applied to every net driver, including the pending one of the next travel.
+  // They do not exist when DO_ENABLE_NET_TEST is off, e.g. in shipping builds.
+  auto setEmulationVariable = [](const TCHAR* name, int32 value)
+    {
+      if (IConsoleVariable* variable = IConsoleManager::Get().FindConsoleVariable(name))
+      {
+        variable->Set(value, ECVF_SetByCode);
+      }
+      else
+      {
+        UE_LOG(LogNetBenchmark, Warning, TEXT("%s is not available in this build, network emulation is off."), name);
+      }
+    };
+
+  setEmulationVariable(TEXT("NetEmulation.PktLag"), profile.PktLag);
+  setEmulationVariable(TEXT("NetEmulation.PktLagVariance"), profile.PktLagVariance);
+  setEmulationVariable(TEXT("NetEmulation.PktIncomingLagMin"), profile.PktIncomingLagMin);
+  setEmulationVariable(TEXT("NetEmulation.PktIncomingLagMax"), profile.PktIncomingLagMax);
+  setEmulationVariable(TEXT("NetEmulation.PktLoss"), profile.PktLoss);
+  setEmulationVariable(TEXT("NetEmulation.PktIncomingLoss"), profile.PktIncomingLoss);
+  setEmulationVariable(TEXT("NetEmulation.PktJitter"), profile.PktJitter);
+}
+
+bool UNetBenchmarkSubsystem::Tick(float deltaTime)
+{
+  if (Phase == EBenchmarkPhase::Idle) return false;
+
+  const double now = FPlatformTime::Seconds();
+  if (Phase == EBenchmarkPhase::ServerTick)
+  {
+    MoveBenchmarkCharacters(now);
+    if (!bPhaseWarmedUp && now - PhaseStartTime >= WarmupSeconds)
+    {
+      bPhaseWarmedUp = true;
+      if (CurrentServerTickPhase.BeginMeasure)
+      {
+        CurrentServerTickPhase.BeginMeasure();
+      }
+    }
+    if (now - PhaseStartTime >= WarmupSeconds + SecondsPerPhase)
+    {
+      FinishServerTickPhase();
+    }
+    return true;
+  }
+
+  APlayerController* playerController = GetGameInstance()->GetFirstLocalPlayerController();
+  APawn* pawn = playerController ? playerController->GetPawn() : nullptr;
+  UWorld* world = playerController ? playerController->GetWorld() : nullptr;
+
+  if (Phase == EBenchmarkPhase::Joining)
+  {
+    if (pawn && world && world != TravelStartWorld.Get() && world->GetNetMode() == NM_Client)
+    {
+      JoinSeconds = now - JoinStartTime;
+      MoveStartTime = now;
+
+      const FCharacterNetMovementCounters& counters = UMyNetworkPluginCharacterMovementComponent::GetNetMovementCounters();
+      StartServerMovesSent = counters.ServerMovesSent;
+      StartCorrectionsReceived = counters.CorrectionsReceived;
+
+      UNetDriver* netDriver = world->GetNetDriver();
+      StartInBytes = netDriver ? netDriver->InTotalBytes : 0;
+      StartOutBytes = netDriver ? netDriver->OutTotalBytes : 0;
+
+      Phase = EBenchmarkPhase::Moving;
+    }
+    else if (now - JoinStartTime > JoinTimeoutSeconds)
+    {
+      FinishProfile(false);
+    }
+    return true;
+  }
+
+  if (!pawn || !world)
+  {
+    // lost the connection while moving
+    FinishProfile(false);
+    return true;
+  }
+
+  // run in a circle so the server has to simulate turns as well as straight moves
+  const float moveTime = static_cast<float>(now - MoveStartTime);
+  pawn->AddMovementInput(FVector(FMath::Cos(moveTime), FMath::Sin(moveTime), 0.0f), 1.0f);
+
+  if (moveTime >= SecondsPerProfile)
+  {
+    FinishProfile(true);
+  }
+  return true;
+}
+
+void UNetBenchmarkSubsystem::StartNextProfile()
+{
+  CurrentProfile = PendingProfiles[0];
+  PendingProfiles.RemoveAt(0);
+
+  UE_LOG(LogNetBenchmark, Display, TEXT("Running profile %s against %s"), *CurrentProfile.Name, *Address);
+  ApplyEmulationProfile(CurrentProfile);
+
+  JoinStartTime = FPlatformTime::Seconds();
+  Phase = EBenchmarkPhase::Joining;
+
+  APlayerController* playerController = GetGameInstance()->GetFirstLocalPlayerController();
+  TravelStartWorld = GetWorld();
+  if (playerController)
+  {
+    playerController->ClientTravel(Address, ETravelType::TRAVEL_Absolute);
+  }
+}
+
+void UNetBenchmarkSubsystem::FinishProfile(bool bJoined)
+{
+  TSharedRef<FJsonObject> result = Report->AddResult();
+  result->SetStringField(TEXT("profile"), CurrentProfile.Name);
+  result->SetNumberField(TEXT("pktLag"), CurrentProfile.PktLag);
+  result->SetNumberField(TEXT("pktLagVariance"), CurrentProfile.PktLagVariance);
+  result->SetNumberField(TEXT("pktLoss"), CurrentProfile.PktLoss);
+  result->SetNumberField(TEXT("pktJitter"), CurrentProfile.PktJitter);
+  result->SetBoolField(TEXT("joined"), bJoined);
+
+  if (bJoined)
+  {
+    const double moveSeconds = FPlatformTime::Seconds() - MoveStartTime;
+    const FCharacterNetMovementCounters& counters = UMyNetworkPluginCharacterMovementComponent::GetNetMovementCounters();
+
+    APlayerController* playerController = GetGameInstance()->GetFirstLocalPlayerController();
+    UNetDriver* netDriver = playerController ? playerController->GetWorld()->GetNetDriver() : nullptr;
+    const uint32 inBytes = netDriver ? netDriver->InTotalBytes - StartInBytes : 0;
+    const uint32 outBytes = netDriver ? netDriver->OutTotalBytes - StartOutBytes : 0;
+
+    result->SetNumberField(TEXT("joinSeconds"), JoinSeconds);
+    result->SetNumberField(TEXT("moveSeconds"), moveSeconds);
+    result->SetNumberField(TEXT("moveRpcsPerSecond"), (counters.ServerMovesSent - StartServerMovesSent) / moveSeconds);
+    result->SetNumberField(TEXT("serverCorrections"), counters.CorrectionsReceived - StartCorrectionsReceived);
+    result->SetNumberField(TEXT("inBytesPerSecond"), inBytes / moveSeconds);
+    result->SetNumberField(TEXT("outBytesPerSecond"), outBytes / moveSeconds);
+  }
+
+  if (PendingProfiles.Num() > 0)
+  {
+    StartNextProfile();
+  }
+  else
+  {
+    ApplyEmulationProfile(FNetEmulationProfile());
+    FinishBenchmark();
+  }
+}
+
+void UNetBenchmarkSubsystem::FinishBenchmark()
+{
+  Phase = EBenchmarkPhase::Idle;
+
+  Report->Save();
+  Report.Reset();
+
+  if (FParse::Param(FCommandLine::Get(), TEXT("NetBenchExit")))
+  {
+    FPlatformMisc::RequestExit(false);
+  }
+}
+
+void UNetBenchmarkSubsystem::StartServerTickBenchmark(const FString& reportName, int32 numCharacters, float secondsPerPhase, TArray<FServerTickBenchmarkPhase> phases)
+{
+  UWorld* world = GetGameInstance()->GetWorld();
+  if (IsRunning() || phases.Num() == 0 || !world || world->GetNetMode() == NM_Client)
+  {
+    UE_LOG(LogNetBenchmark, Warning, TEXT("Server tick benchmarks need an idle benchmark and a server or standalone world."));
+    return;
+  }
+
+  ServerWorld = world;
+  TickDispatchHandle = world->OnTickDispatch().AddUObject(this, &ThisClass::OnServerTickDispatch);
+  PostTickFlushHandle = world->OnPostTickFlush().AddUObject(this, &ThisClass::OnServerPostTickFlush);
+
+  SecondsPerPhase = FMath::Max(secondsPerPhase, 1.0f);
+  PendingServerTickPhases = MoveTemp(phases);
+  Report = MakeUnique<FNetBenchmarkReport>(reportName);
+  Report->Root->SetNumberField(TEXT("numCharacters"), numCharacters);
+  Report->Root->SetNumberField(TEXT("secondsPerPhase"), SecondsPerPhase);
+
+  SpawnBenchmarkCharacters(numCharacters);
+
+  TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &ThisClass::Tick));
+  StartNextServerTickPhase();
+}
+
+void UNetBenchmarkSubsystem::SpawnBenchmarkCharacters(int32 numCharacters)
+{
+  UWorld* world = GetGameInstance()->GetWorld();
+  AGameModeBase* gameMode = world ? world->GetAuthGameMode() : nullptr;
+  if (!gameMode || !gameMode->DefaultPawnClass) return;
+
+  TActorIterator<APlayerStart> playerStart(world);
+  const FVector origin = playerStart ? playerStart->GetActorLocation() : FVector::ZeroVector;
+  const int32 gridSize = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(numCharacters)));
+
+  FActorSpawnParameters spawnParameters;
+  spawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+  for (int32 i = 0; i < numCharacters; ++i)
+  {
+    // keep them apart so they do not block each other
+    const FVector location = origin + FVector((i % gridSize) * 300.0f, (i / gridSize) * 300.0f, 0.0f);
+    APawn* pawn = world->SpawnActor<APawn>(gameMode->DefaultPawnClass, location, FRotator::ZeroRotator, spawnParameters);
+    if (!pawn) continue;
+
+    if (!pawn->GetController())
+    {
+      pawn->SpawnDefaultController();
+    }
+    BenchmarkCharacters.Add(pawn);
+  }
+}
+
+void UNetBenchmarkSubsystem::DestroyBenchmarkCharacters()
+{
+  for (const TWeakObjectPtr<APawn>& pawn : BenchmarkCharacters)
+  {
+    if (pawn.IsValid())
+    {
+      if (AController* controller = pawn->GetController())
+      {
+        controller->Destroy();
+      }
+      pawn->Destroy();
+    }
+  }
+  BenchmarkCharacters.Reset();
+}
+
+void UNetBenchmarkSubsystem::MoveBenchmarkCharacters(double time)
+{
+  for (int32 i = 0; i < BenchmarkCharacters.Num(); ++i)
+  {
+    if (APawn* pawn = BenchmarkCharacters[i].Get())
+    {
+      // every character runs its own circle, offset so they are not in lockstep
+      const float angle = static_cast<float>(time) + i * 0.7f;
+      pawn->AddMovementInput(FVector(FMath::Cos(angle), FMath::Sin(angle), 0.0f), 1.0f);
+    }
+  }
+}
+
+void UNetBenchmarkSubsystem::StartNextServerTickPhase()
+{
+  CurrentServerTickPhase = PendingServerTickPhases[0];
+  PendingServerTickPhases.RemoveAt(0);
+
+  UE_LOG(LogNetBenchmark, Display, TEXT("Running server tick phase %s with %d characters"), *CurrentServerTickPhase.Name, BenchmarkCharacters.Num());
+  if (CurrentServerTickPhase.Begin)
+  {
+    CurrentServerTickPhase.Begin();
+  }
+
+  ServerTickSamplesMs.Reset();
+  PhaseStartTime = FPlatformTime::Seconds();
+  bPhaseWarmedUp = false;
+  Phase = EBenchmarkPhase::ServerTick;
+}
+
+void UNetBenchmarkSubsystem::FinishServerTickPhase()
+{
+  if (CurrentServerTickPhase.End)
+  {
+    CurrentServerTickPhase.End();
+  }
+
+  TSharedRef<FJsonObject> result = Report->AddResult();
+  result->SetStringField(TEXT("phase"), CurrentServerTickPhase.Name);
+  result->SetNumberField(TEXT("frames"), ServerTickSamplesMs.Num());
+  if (ServerTickSamplesMs.Num() > 0)
+  {
+    ServerTickSamplesMs.Sort();
+    double totalMs = 0.0;
+    for (double sample : ServerTickSamplesMs)
+    {
+      totalMs += sample;
+    }
+    result->SetNumberField(TEXT("avgTickMs"), totalMs / ServerTickSamplesMs.Num());
+    result->SetNumberField(TEXT("p50TickMs"), ServerTickSamplesMs[ServerTickSamplesMs.Num() / 2]);
+    result->SetNumberField(TEXT("p95TickMs"), ServerTickSamplesMs[FMath::Min(ServerTickSamplesMs.Num() * 95 / 100, ServerTickSamplesMs.Num() - 1)]);
+    result->SetNumberField(TEXT("maxTickMs"), ServerTickSamplesMs.Last());
+  }
+  if (CurrentServerTickPhase.AddResults)
+  {
+    CurrentServerTickPhase.AddResults(*result);
+  }
+
+  if (PendingServerTickPhases.Num() > 0)
+  {
+    StartNextServerTickPhase();
+    return;
+  }
+
+  if (UWorld* world = ServerWorld.Get())
+  {
+    world->OnTickDispatch().Remove(TickDispatchHandle);
+    world->OnPostTickFlush().Remove(PostTickFlushHandle);
+  }
+  DestroyBenchmarkCharacters();
+  FinishBenchmark();
+}
+
+void UNetBenchmarkSubsystem::OnServerTickDispatch(float deltaTime)
+{
+  TickStartTime = FPlatformTime::Seconds();
+}
+
+void UNetBenchmarkSubsystem::OnServerPostTickFlush()
+{
+  if (Phase != EBenchmarkPhase::ServerTick || TickStartTime <= 0.0) return;
+
+  const double now = FPlatformTime::Seconds();
+  if (now - PhaseStartTime >= WarmupSeconds)
+  {
+    ServerTickSamplesMs.Add((now - TickStartTime) * 1000.0);
+  }
+  TickStartTime = 0.0;
+}
@@ -0,0 +1,283 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PacketCompressionBenchmarkCommandlet.h"
+#include "NetBenchmarkSubsystem.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/Paths.h"
+#include "OodleNetworkArchives.h"
+#include "OodleNetworkHandlerComponent.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogPacketCompressionBenchmark, Log, All);
+
+#ifndef HAS_OODLE_NET_SDK
+#define HAS_OODLE_NET_SDK 0
+#endif
+
+#if HAS_OODLE_NET_SDK
+// Same hash table size and dictionary size limit as the dictionaries the trainer commandlet writes
+static const int32 HashTableBits = 19;
+static const int32 MaxDictionaryBytes = 4 * 1024 * 1024;
+static const uint32 MaxPacketBytes = 16384;
+
+static TArray<TArray<uint8>> ReadCapturedPackets(const FString& captureDirectory)
+{
+  TArray<TArray<uint8>> packets;
+
+  TArray<FString> captureFiles;
+  IFileManager::Get().FindFilesRecursive(captureFiles, *captureDirectory, TEXT("*.ucap"), true, false);
+  captureFiles.Sort();
+
+  for (const FString& captureFile : captureFiles)
+  {
+    TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*captureFile));
+    if (!reader) continue;
+
+    FPacketCaptureArchive capture(*reader);
+    capture.SerializeCaptureHeader();
+
+    uint8 buffer[MaxPacketBytes];
+    while (!capture.IsError() && capture.Tell() < capture.TotalSize())
+    {
+      uint32 packetSize = MaxPacketBytes;
+      capture.SerializePacket(buffer, packetSize);
+      if (capture.IsError() || packetSize == 0) break;
+
+      packets.Emplace(buffer, packetSize);
+    }
+
+    if (capture.IsError())
+    {
+      UE_LOG(LogPacketCompressionBenchmark, Warning, TEXT("Stopped reading %s at a corrupt packet"), *captureFile);
+    }
+  }
+
+  UE_LOG(LogPacketCompressionBenchmark, Display, TEXT("Read %d packets from %d captures in %s"), packets.Num(), captureFiles.Num(), *captureDirectory);
+  return packets;
+}
+
+// Shared dictionary and compressor state a stream is encoded and decoded with
+struct FPacketCompressionDictionary
+{
+  TArray<uint8> SharedMemory;
+  TArray<uint8> StateMemory;
+  // The window the shared dictionary points into, it has to outlive it
+  TArray<uint8> Window;
+  FString Source;
+
+  OodleNetwork1_Shared* GetShared() { return reinterpret_cast<OodleNetwork1_Shared*>(SharedMemory.GetData()); }
+  OodleNetwork1UDP_State* GetState() { return reinterpret_cast<OodleNetwork1UDP_State*>(StateMemory.GetData()); }
+};
+
+// Loads a dictionary the way the Oodle network handler does, from a path relative to the project
+static bool LoadDictionary(const FString& dictionaryPath, FPacketCompressionDictionary& dictionary)
+{
+  const FString path = FPaths::IsRelative(dictionaryPath) ? FPaths::ProjectDir() / dictionaryPath : dictionaryPath;
+  TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*path));
+  if (!reader) return false;
+
+  FOodleNetworkDictionaryArchive archive(*reader);
+  uint8* windowData = nullptr;
+  uint32 windowBytes = 0;
+  uint8* compactStateData = nullptr;
+  uint32 compactStateBytes = 0;
+
+  archive.SerializeHeader();
+  archive.SerializeDictionaryAndState(windowData, windowBytes, compactStateData, compactStateBytes);
+
+  const bool bLoaded = !archive.IsError() && windowData && compactStateData;
+  if (bLoaded)
+  {
+    const int32 hashTableBits = archive.Header.HashTableSize.Get();
+    dictionary.Window = TArray<uint8>(windowData, windowBytes);
+    dictionary.SharedMemory.SetNumZeroed(OodleNetwork1_Shared_Size(hashTableBits));
+    OodleNetwork1_Shared_SetWindow(dictionary.GetShared(), hashTableBits, dictionary.Window.GetData(), dictionary.Window.Num());
+    dictionary.StateMemory.SetNumZeroed(OodleNetwork1UDP_State_Size());
+    OodleNetwork1UDP_State_Uncompact(dictionary.GetState(), reinterpret_cast<OodleNetwork1UDP_StateCompacted*>(compactStateData));
+    dictionary.Source = path;
+  }
+
+  FMemory::Free(windowData);
+  FMemory::Free(compactStateData);
+  return bLoaded;
+}
+
+// Trains a dictionary on the first numTrainPackets of a stream, for comparing against the shipped one
+static void TrainDictionary(const TArray<TArray<uint8>>& packets, int32 numTrainPackets, FPacketCompressionDictionary& dictionary)
+{
+  // the dictionary window is the most recent training traffic, like the trainer commandlet builds it
+  for (int32 index = numTrainPackets - 1; index >= 0 && dictionary.Window.Num() + packets[index].Num() <= MaxDictionaryBytes; --index)
+  {
+    dictionary.Window.Insert(packets[index], 0);
+  }
+
+  dictionary.SharedMemory.SetNumZeroed(OodleNetwork1_Shared_Size(HashTableBits));
+  OodleNetwork1_Shared_SetWindow(dictionary.GetShared(), HashTableBits, dictionary.Window.GetData(), dictionary.Window.Num());
+
+  TArray<const void*> trainPacketData;
+  TArray<OO_S32> trainPacketSizes;
+  for (int32 index = 0; index < numTrainPackets; ++index)
+  {
+    trainPacketData.Add(packets[index].GetData());
+    trainPacketSizes.Add(packets[index].Num());
+  }
+
+  dictionary.StateMemory.SetNumZeroed(OodleNetwork1UDP_State_Size());
+  OodleNetwork1UDP_Train(dictionary.GetState(), dictionary.GetShared(), trainPacketData.GetData(), trainPacketSizes.GetData(), numTrainPackets);
+  dictionary.Source = FString::Printf(TEXT("trained on %d packets"), numTrainPackets);
+}
+
+// Measures the packets from firstPacket on, returns the number of packets that did not decode back to what was encoded
+static int32 MeasureCompression(const FString& streamName, const TArray<TArray<uint8>>& packets, int32 firstPacket, FPacketCompressionDictionary& dictionary, FNetBenchmarkReport& report)
+{
+  OodleNetwork1_Shared* shared = dictionary.GetShared();
+  OodleNetwork1UDP_State* state = dictionary.GetState();
+
+  TArray<uint8> compressed;
+  compressed.SetNumUninitialized(OodleNetwork1_CompressedBufferSizeNeeded(MaxPacketBytes));
+  TArray<uint8> decompressed;
+  decompressed.SetNumUninitialized(MaxPacketBytes);
+
+  int64 rawBytes = 0;
+  int64 sentBytes = 0;
+  int32 numPackets = 0;
+  int32 numCompressedPackets = 0;
+  int32 numMismatches = 0;
+  uint64 encodeCycles = 0;
+  uint64 decodeCycles = 0;
+
+  for (int32 index = firstPacket; index < packets.Num(); ++index)
+  {
+    const TArray<uint8>& packet = packets[index];
+
+    const uint64 encodeStart = FPlatformTime::Cycles64();
+    const OO_SINTa compressedSize = OodleNetwork1UDP_Encode(state, shared, packet.GetData(), packet.Num(), compressed.GetData());
+    encodeCycles += FPlatformTime::Cycles64() - encodeStart;
+
+    ++numPackets;
+    rawBytes += packet.Num();
+
+    // packets that do not shrink are sent as they are
+    if (compressedSize <= 0 || compressedSize >= packet.Num())
+    {
+      sentBytes += packet.Num();
+      continue;
+    }
+
+    ++numCompressedPackets;
+    sentBytes += compressedSize;
+
+    const uint64 decodeStart = FPlatformTime::Cycles64();
+    const bool bDecoded = OodleNetwork1UDP_Decode(state, shared, compressed.GetData(), compressedSize, decompressed.GetData(), packet.Num()) != 0;
+    decodeCycles += FPlatformTime::Cycles64() - decodeStart;
+
+    if (!bDecoded || FMemory::Memcmp(decompressed.GetData(), packet.GetData(), packet.Num()) != 0)
+    {
+      ++numMismatches;
+    }
+  }
+
+  const double compressionRatio = sentBytes > 0 ? static_cast<double>(rawBytes) / sentBytes : 1.0;
+  const double encodeUsPerPacket = FPlatformTime::ToMilliseconds64(encodeCycles) * 1000.0 / numPackets;
+  const double decodeUsPerPacket = numCompressedPackets > 0 ? FPlatformTime::ToMilliseconds64(decodeCycles) * 1000.0 / numCompressedPackets : 0.0;
+
+  TSharedRef<FJsonObject> result = report.AddResult();
+  result->SetStringField(TEXT("stream"), streamName);
+  result->SetStringField(TEXT("dictionary"), dictionary.Source);
+  result->SetNumberField(TEXT("dictionaryBytes"), dictionary.Window.Num());
+  result->SetNumberField(TEXT("packets"), numPackets);
+  result->SetNumberField(TEXT("compressedPackets"), numCompressedPackets);
+  result->SetNumberField(TEXT("rawBytes"), static_cast<double>(rawBytes));
+  result->SetNumberField(TEXT("sentBytes"), static_cast<double>(sentBytes));
+  result->SetNumberField(TEXT("compressionRatio"), compressionRatio);
+  result->SetNumberField(TEXT("savedPercent"), rawBytes > 0 ? 100.0 * (rawBytes - sentBytes) / rawBytes : 0.0);
+  result->SetNumberField(TEXT("encodeUsPerPacket"), encodeUsPerPacket);
+  result->SetNumberField(TEXT("decodeUsPerPacket"), decodeUsPerPacket);
+  result->SetNumberField(TEXT("mismatches"), numMismatches);
+
+  UE_LOG(LogPacketCompressionBenchmark, Display, TEXT("%s: %d packets, ratio %.2f (%.1f%% saved), encode %.2f us, decode %.2f us per packet, %d mismatches"),
+    *streamName, numPackets, compressionRatio, rawBytes > 0 ? 100.0 * (rawBytes - sentBytes) / rawBytes : 0.0, encodeUsPerPacket, decodeUsPerPacket, numMismatches);
+  return numMismatches;
+}
+#endif
+
+UPacketCompressionBenchmarkCommandlet::UPacketCompressionBenchmarkCommandlet()
+{
+  IsClient = false;
+  IsServer = false;
+  IsEditor = false;
+  LogToConsole = true;
+}
+
+int32 UPacketCompressionBenchmarkCommandlet::Main(const FString& Params)
+{
+#if HAS_OODLE_NET_SDK
+  FString capturesDirectory = FPaths::ProjectSavedDir() / TEXT("Oodle");
+  FParse::Value(*Params, TEXT("Captures="), capturesDirectory);
+
+  // by default the dictionaries the game ships with are measured, -Train trains throwaway ones on the captures
+  const bool bTrain = FParse::Param(*Params, TEXT("Train"));
+  float trainShare = 0.75f;
+  FParse::Value(*Params, TEXT("TrainShare="), trainShare);
+  trainShare = FMath::Clamp(trainShare, 0.05f, 0.95f);
+
+  FNetBenchmarkReport report(TEXT("PacketCompression"));
+  report.Root->SetStringField(TEXT("captures"), capturesDirectory);
+  report.Root->SetBoolField(TEXT("trained"), bTrain);
+  if (bTrain)
+  {
+    report.Root->SetNumberField(TEXT("trainShare"), trainShare);
+  }
+
+  // server captures hold what the host sends, client captures what the clients send
+  int32 numMismatches = 0;
+  for (const TCHAR* streamName : { TEXT("Server"), TEXT("Client") })
+  {
+    const TArray<TArray<uint8>> packets = ReadCapturedPackets(capturesDirectory / streamName);
+    if (packets.Num() < 2)
+    {
+      UE_LOG(LogPacketCompressionBenchmark, Warning, TEXT("Not enough %s packets captured, set bCaptureMode=true in [OodleNetworkHandlerComponent] and play a session"), streamName);
+      continue;
+    }
+
+    FPacketCompressionDictionary dictionary;
+    int32 firstPacket = 0;
+    if (bTrain)
+    {
+      firstPacket = FMath::Clamp(FMath::FloorToInt(packets.Num() * trainShare), 1, packets.Num() - 1);
+      TrainDictionary(packets, firstPacket, dictionary);
+    }
+    else
+    {
+      FString dictionaryPath;
+      GConfig->GetString(TEXT("OodleNetworkHandlerComponent"), *FString::Printf(TEXT("%sDictionary"), streamName), dictionaryPath, GEngineIni);
+      if (dictionaryPath.IsEmpty() || !LoadDictionary(dictionaryPath, dictionary))
+      {
+        UE_LOG(LogPacketCompressionBenchmark, Error, TEXT("Could not load the %s dictionary '%s' configured in [OodleNetworkHandlerComponent], train it as DefaultEngine.ini describes or pass -Train"),
+          streamName, *dictionaryPath);
+        return 1;
+      }
+    }
+
+    numMismatches += MeasureCompression(streamName, packets, firstPacket, dictionary, report);
+  }
+
+  if (report.Results.Num() == 0) return 1;
+
+  const FString path = report.Save();
+  UE_LOG(LogPacketCompressionBenchmark, Display, TEXT("Wrote %s"), *path);
+
+  // a dictionary that does not round trip must fail the run, not only show up in the report
+  if (numMismatches > 0)
+  {
+    UE_LOG(LogPacketCompressionBenchmark, Error, TEXT("%d packets did not decode to what was encoded"), numMismatches);
+    return 2;
+  }
+  return path.IsEmpty() ? 1 : 0;
+#else
+  UE_LOG(LogPacketCompressionBenchmark, Error, TEXT("The Oodle network SDK is not available on this platform"));
+  return 1;
+#endif
+}
@@ -0,0 +1,257 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "QuantizedCharacterMovement.h"
+#include "NetBenchmarkSubsystem.h"
+#include "Engine/GameInstance.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogQuantizedMovement, Log, All);
+
+static int32 GQuantizedCharacterMovement = 1;
+static FAutoConsoleVariableRef CVarQuantizedCharacterMovement(
+  TEXT("net.QuantizedCharacterMovement"),
+  GQuantizedCharacterMovement,
+  TEXT("1: characters replicate their movement to simulated proxies quantized and delta encoded, 0: as ReplicatedMovement"));
+
+static FAutoConsoleCommandWithWorldAndArgs NetBenchMovementBandwidthCommand(
+  TEXT("NetBench.MovementBandwidth"),
+  TEXT("NetBench.MovementBandwidth [NumCharacters] [SecondsPerPhase]: bytes per client per second with ReplicatedMovement and with quantized movement, run on the host with clients connected"),
+  FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+    {
+      UNetBenchmarkSubsystem* benchmark = world && world->GetGameInstance() ? world->GetGameInstance()->GetSubsystem<UNetBenchmarkSubsystem>() : nullptr;
+      UNetDriver* netDriver = world ? world->GetNetDriver() : nullptr;
+      if (!benchmark || !netDriver || netDriver->ClientConnections.Num() == 0)
+      {
+        UE_LOG(LogQuantizedMovement, Warning, TEXT("NetBench.MovementBandwidth needs a host with at least one client connected."));
+        return;
+      }
+
+      const int32 numCharacters = args.IsValidIndex(0) ? FCString::Atoi(*args[0]) : 32;
+      const float seconds = args.IsValidIndex(1) ? FCString::Atof(*args[1]) : 10.0f;
+
+      TWeakObjectPtr<UNetDriver> weakNetDriver = netDriver;
+      auto addPhase = [&weakNetDriver](TArray<FServerTickBenchmarkPhase>& phases, const TCHAR* name, int32 quantized)
+        {
+          TSharedRef<TTuple<uint32, double>> start = MakeShared<TTuple<uint32, double>>(0, 0.0);
+
+          FServerTickBenchmarkPhase& phase = phases.AddDefaulted_GetRef();
+          phase.Name = name;
+          phase.Begin = [quantized]() { GQuantizedCharacterMovement = quantized; };
+          // after the warmup, so the initial replication of the spawned characters is not counted
+          phase.BeginMeasure = [weakNetDriver, start]()
+            {
+              start->Get<0>() = weakNetDriver.IsValid() ? weakNetDriver->OutTotalBytes : 0;
+              start->Get<1>() = FPlatformTime::Seconds();
+            };
+          phase.AddResults = [weakNetDriver, start](FJsonObject& result)
+            {
+              if (!weakNetDriver.IsValid()) return;
+
+              const double phaseSeconds = FPlatformTime::Seconds() - start->Get<1>();
+              const int32 numClients = FMath::Max(weakNetDriver->ClientConnections.Num(), 1);
+              const uint32 outBytes = weakNetDriver->OutTotalBytes - start->Get<0>();
+              result.SetNumberField(TEXT("clients"), numClients);
+              result.SetNumberField(TEXT("bytesPerClientPerSecond"), outBytes / phaseSeconds / numClients);
+            };
+        };
+
+      TArray<FServerTickBenchmarkPhase> phases;
+      addPhase(phases, TEXT("ReplicatedMovement"), 0);
+      addPhase(phases, TEXT("QuantizedMovement"), 1);
+      const int32 previousQuantized = GQuantizedCharacterMovement;
+      phases.Last().End = [previousQuantized]() { GQuantizedCharacterMovement = previousQuantized; };
+
+      benchmark->StartServerTickBenchmark(TEXT("MovementBandwidth"), numCharacters, seconds, MoveTemp(phases));
+    }));
+
+/**
+ * What the connection has of the movement after an update, the base of the next one
+ */
+class FQuantizedMovementBaseState : public INetDeltaBaseState
+{
+public:
+  virtual bool IsStateEqual(INetDeltaBaseState* otherState) override
+  {
+    return Id == static_cast<FQuantizedMovementBaseState*>(otherState)->Id;
+  }
+
+  uint32 Id = 0;
+  double CreationTime = 0.0;
+  FQuantizedMovementState State;
+};
+
+static int32 GetRotationBits(const FMovementQuantization& quantization, int32 component)
+{
+  return component == FQuantizedMovementState::FirstRotationComponent + 1 ? quantization.YawBits : quantization.PitchRollBits;
+}
+
+static int32 QuantizeAngle(double angle, int32 bits)
+{
+  const int32 steps = 1 << bits;
+  return FMath::RoundToInt(FRotator::ClampAxis(angle) * steps / 360.0) & (steps - 1);
+}
+
+// Rotations wrap around, the shortest way from base to the new value
+static int32 WrapDelta(int32 delta, int32 bits)
+{
+  const int32 steps = 1 << bits;
+  return ((delta + steps / 2) & (steps - 1)) - steps / 2;
+}
+
+// Zigzag encoded value in as many bits as it needs, preceded by that count. Never called for 0.
+static void WriteDelta(FBitWriter& writer, int32 value)
+{
+  uint32 zigzag = (static_cast<uint32>(value) << 1) ^ static_cast<uint32>(value >> 31);
+  const uint32 numBits = FMath::FloorLog2(zigzag) + 1;
+  writer.WriteInt(numBits - 1, 32);
+  writer.SerializeBits(&zigzag, numBits);
+}
+
+static int32 ReadDelta(FBitReader& reader)
+{
+  const uint32 numBits = reader.ReadInt(32) + 1;
+  uint32 zigzag = 0;
+  reader.SerializeBits(&zigzag, numBits);
+  return static_cast<int32>(zigzag >> 1) ^ -static_cast<int32>(zigzag & 1);
+}
+
+FQuantizedMovementState FQuantizedMovementState::Quantize(const FMovementQuantization& quantization, const FVector& location, const FRotator& rotation, const FVector& velocity)
+{
+  FQuantizedMovementState state;
+  for (int32 axis = 0; axis < 3; ++axis)
+  {
+    state.Components[axis] = FMath::RoundToInt(location[axis] / quantization.LocationCm);
+    state.Components[3 + axis] = FMath::RoundToInt(velocity[axis] / quantization.VelocityCmPerSecond);
+  }
+  state.Components[FirstRotationComponent] = QuantizeAngle(rotation.Pitch, quantization.PitchRollBits);
+  state.Components[FirstRotationComponent + 1] = QuantizeAngle(rotation.Yaw, quantization.YawBits);
+  state.Components[FirstRotationComponent + 2] = QuantizeAngle(rotation.Roll, quantization.PitchRollBits);
+  return state;
+}
+
+void FQuantizedMovementState::Dequantize(const FMovementQuantization& quantization, FVector& outLocation, FRotator& outRotation, FVector& outVelocity) const
+{
+  for (int32 axis = 0; axis < 3; ++axis)
+  {
+    outLocation[axis] = Components[axis] * quantization.LocationCm;
+    outVelocity[axis] = Components[3 + axis] * quantization.VelocityCmPerSecond;
+  }
+  outRotation.Pitch = Components[FirstRotationComponent] * 360.0 / (1 << quantization.PitchRollBits);
+  outRotation.Yaw = Components[FirstRotationComponent + 1] * 360.0 / (1 << quantization.YawBits);
+  outRotation.Roll = Components[FirstRotationComponent + 2] * 360.0 / (1 << quantization.PitchRollBits);
+}
+
+bool FQuantizedMovementState::operator==(const FQuantizedMovementState& other) const
+{
+  return FMemory::Memcmp(Components, other.Components, sizeof(Components)) == 0;
+}
+
+bool FQuantizedCharacterMovement::IsEnabled()
+{
+  return GQuantizedCharacterMovement != 0;
+}
+
+bool FQuantizedCharacterMovement::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+  if (DeltaParms.Writer)
+  {
+    const FQuantizedMovementBaseState* oldState = static_cast<const FQuantizedMovementBaseState*>(DeltaParms.OldState);
+    if (oldState && oldState->State == Current) return false;
+
+    const double now = FPlatformTime::Seconds();
+    const bool bHasBase = oldState && now - oldState->CreationTime <= MaxBaseAgeSeconds;
+    const FQuantizedMovementState base = bHasBase ? oldState->State : FQuantizedMovementState();
+
+    TSharedPtr<FQuantizedMovementBaseState> newState = MakeShared<FQuantizedMovementBaseState>();
+    newState->Id = NextStateId++;
+    newState->CreationTime = bHasBase ? oldState->CreationTime : now;
+    newState->State = Current;
+    *DeltaParms.NewState = newState;
+
+    int32 deltas[FQuantizedMovementState::NumComponents];
+    uint32 changedMask = 0;
+    for (int32 component = 0; component < FQuantizedMovementState::NumComponents; ++component)
+    {
+      deltas[component] = Current.Components[component] - base.Components[component];
+      if (component >= FQuantizedMovementState::FirstRotationComponent)
+      {
+        deltas[component] = WrapDelta(deltas[component], GetRotationBits(Quantization, component));
+      }
+      changedMask |= deltas[component] != 0 ? 1u << component : 0u;
+    }
+
+    FBitWriter& writer = *DeltaParms.Writer;
+    uint32 newId = newState->Id;
+    writer.SerializeIntPacked(newId);
+    writer.WriteBit(bHasBase ? 1 : 0);
+    if (bHasBase)
+    {
+      uint32 baseId = oldState->Id;
+      writer.SerializeIntPacked(baseId);
+    }
+    writer.SerializeBits(&changedMask, FQuantizedMovementState::NumComponents);
+    for (int32 component = 0; component < FQuantizedMovementState::NumComponents; ++component)
+    {
+      if (changedMask & (1u << component))
+      {
+        WriteDelta(writer, deltas[component]);
+      }
+    }
+    return true;
+  }
+
+  if (DeltaParms.Reader)
+  {
+    FBitReader& reader = *DeltaParms.Reader;
+    uint32 newId = 0;
+    reader.SerializeIntPacked(newId);
+    const bool bHasBase = reader.ReadBit() != 0;
+    uint32 baseId = 0;
+    if (bHasBase)
+    {
+      reader.SerializeIntPacked(baseId);
+    }
+    uint32 changedMask = 0;
+    reader.SerializeBits(&changedMask, FQuantizedMovementState::NumComponents);
+
+    if (ReceivedStates.Num() == 0)
+    {
+      ReceivedStates.SetNum(NumReceivedStates);
+    }
+
+    // the base was in an update this client never got, the server resends against an older one
+    const FReceivedState& baseEntry = ReceivedStates[baseId % NumReceivedStates];
+    const bool bBaseMissing = bHasBase && baseEntry.Id != baseId;
+    FQuantizedMovementState state = bHasBase && !bBaseMissing ? baseEntry.State : FQuantizedMovementState();
+
+    for (int32 component = 0; component < FQuantizedMovementState::NumComponents; ++component)
+    {
+      if (changedMask & (1u << component))
+      {
+        state.Components[component] += ReadDelta(reader);
+        if (component >= FQuantizedMovementState::FirstRotationComponent)
+        {
+          state.Components[component] &= (1 << GetRotationBits(Quantization, component)) - 1;
+        }
+      }
+    }
+
+    if (reader.IsError()) return false;
+    if (bBaseMissing)
+    {
+      UE_LOG(LogQuantizedMovement, Verbose, TEXT("Dropped movement update %u, base %u is not known"), newId, baseId);
+      return true;
+    }
+
+    ReceivedStates[newId % NumReceivedStates] = { newId, state };
+    Received = state;
+    bReceived = true;
+    return true;
+  }
+
+  return true;
+}
@@ -0,0 +1,21 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/PlatformTime.h"
+
+/**
+ * Game thread time of one component tick, averaged over about the last second at 60 Hz
+ */
+struct FComponentTickCost
+{
+	float AverageMs = 0.0f;
+	float LastMs = 0.0f;
+
+	void Add(uint64 cycles)
+	{
+		LastMs = static_cast<float>(FPlatformTime::ToMilliseconds64(cycles));
+		AverageMs = AverageMs > 0.0f ? FMath::Lerp(AverageMs, LastMs, 1.0f / 64.0f) : LastMs;
+	}
+};
@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "HAL/PlatformProcess.h"
+#include "NetBenchmarkSubsystem.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ConnectionMemorySubsystem.generated.h"
+
+class UNetConnection;
+
+/**
+ * Host memory of one client connection by category, as counted by the engine's memory counting serialization
+ */
+struct FConnectionMemory
+{
+	FString Name;
+	int32 NumChannels = 0;
+	// The net connection and its package map: send buffer, reliable and ack bookkeeping, exported GUIDs
+	SIZE_T ConnectionBytes = 0;
+	// Actor channels of the connection without their object replicators
+	SIZE_T ChannelBytes = 0;
+	// Object replicators of the actor channels: shadow state, retirement and history of the replicated properties.
+	// The changelist state a net driver shares between all connections is not part of any connection.
+	SIZE_T ReplicatedStateBytes = 0;
+	// Player controller and player state with their components
+	SIZE_T ControllerBytes = 0;
+	// Pawn with its components
+	SIZE_T PawnBytes = 0;
+
+	SIZE_T GetTotalBytes() const { return ConnectionBytes + ChannelBytes + ReplicatedStateBytes + ControllerBytes + PawnBytes; }
+	void Accumulate(const FConnectionMemory& other);
+};
+
+/**
+ * Reports how much host memory each connected player costs, to size hosts for more public connections.
+ *
+ * Net.ConnectionMemory logs every client connection and the total by category, net.ConnectionMemory.CsvIntervalSeconds
+ * appends the same to Saved/Profiling/ConnectionMemory-*.csv periodically and NetBench.ConnectionMemory launches
+ * increasing numbers of headless clients and reports the memory per player at every step.
+ */
+UCLASS()
+class MYNETWORKPLUGIN_API UConnectionMemorySubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Deinitialize() override;
+
+	// Memory of every client connection of the game net driver, returns the total of them
+	FConnectionMemory CollectConnectionMemory(TArray<FConnectionMemory>& outConnections) const;
+	static FConnectionMemory CountConnectionMemory(UNetConnection* connection);
+
+	// Logs the memory of every client connection and the total, see Net.ConnectionMemory
+	void LogConnectionMemory() const;
+
+	// Launches headless clients in steps of 1, 2, 4... up to maxClients or the free slots of the session, one every
+	// net.ConnectionMemory.LaunchIntervalSeconds, and measures once all of a step play and secondsPerStep passed, see NetBench.ConnectionMemory
+	void StartClientBenchmark(int32 maxClients, float secondsPerStep);
+	bool IsBenchmarkRunning() const { return Report.IsValid(); }
+
+	// Clients of the game net driver that play with a pawn
+	int32 GetNumPlayingClients() const;
+
+private:
+	bool Tick(float deltaTime);
+	void WriteCsvRows();
+
+	bool LaunchClient();
+	void StartNextBenchmarkStep();
+	void RecordBenchmarkStep(bool bTimedOut);
+	void FinishClientBenchmark();
+
+private:
+	FTSTicker::FDelegateHandle TickerHandle;
+
+	FString CsvPath;
+	double NextCsvSeconds = 0.0;
+
+	TUniquePtr<FNetBenchmarkReport> Report;
+	TArray<FProcHandle> ClientProcesses;
+	TArray<FString> StepRows;
+	int32 BenchmarkMaxClients = 0;
+	int32 BenchmarkStepClients = 0;
+	float BenchmarkSecondsPerStep = 0.0f;
+	// Start of the step, then the last launch of a client of it
+	double StepStartSeconds = 0.0;
+	double NextLaunchSeconds = 0.0;
+	// Set once all clients of the step play, the step is measured secondsPerStep later
+	double StepPlayingSeconds = 0.0;
+	uint64 BaselineUsedPhysical = 0;
+};
@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "JoinAdmissionComponent.generated.h"
+
+class APlayerController;
+struct FUniqueNetIdRepl;
+
+/**
+ * Admission control at PreLogin, before a player controller, pawn or channels exist for the joining client.
+ *
+ * Joins are limited by the NumPublicConnections of the advertised session and by a token bucket of
+ * JoinsPerSecond. A client that cannot join yet is rejected with "Queued: position N of M" and keeps its place in
+ * the queue as long as it retries within QueueEntryTimeoutSeconds. Admitted clients hold a reservation until
+ * PostLogin so concurrent handshakes can not overfill the session. When logged in players take every slot the
+ * client is rejected as full right away, only slots held by reservations are worth waiting for.
+ */
+UCLASS(Config = Game, ClassGroup = (Network), meta = (BlueprintSpawnableComponent))
+class MYNETWORKPLUGIN_API UJoinAdmissionComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UJoinAdmissionComponent();
+
+	// Empty when the player may join, otherwise the error the login is rejected with
+	FString AdmitPlayer(const FUniqueNetIdRepl& uniqueId, const FString& address);
+	void OnPlayerLoggedIn(APlayerController* newPlayer);
+
+	int32 GetCapacity() const;
+	int32 GetNumReservations() const { return Reservations.Num(); }
+	int32 GetQueueLength() const { return Queue.Num(); }
+	float GetJoinTokens() const { return JoinTokens; }
+
+private:
+	struct FJoinQueueEntry
+	{
+		FString PlayerKey;
+		double ExpireTime = 0.0;
+	};
+
+	void RefillJoinTokens(double now);
+	void RemoveExpired(double now);
+	FString QueuePlayer(const FString& playerKey, double now);
+
+private:
+	// Sustained joins per second and the burst allowed on top of it
+	UPROPERTY(Config, EditAnywhere, Category = "Admission")
+	float JoinsPerSecond = 2.0f;
+	UPROPERTY(Config, EditAnywhere, Category = "Admission")
+	int32 JoinBurst = 4;
+
+	// Clients waiting for a slot, more are rejected as busy
+	UPROPERTY(Config, EditAnywhere, Category = "Admission")
+	int32 MaxQueueLength = 32;
+
+	// A queued client loses its place when it does not retry within this time
+	UPROPERTY(Config, EditAnywhere, Category = "Admission")
+	float QueueEntryTimeoutSeconds = 15.0f;
+
+	// An admitted client has this long to finish the login before its slot is given away
+	UPROPERTY(Config, EditAnywhere, Category = "Admission")
+	float ReservationTimeoutSeconds = 30.0f;
+
+	TArray<FJoinQueueEntry> Queue;
+	TMap<FString, double> Reservations;
+
+	float JoinTokens = 0.0f;
+	double LastRefillTime = 0.0;
+};
@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Containers/Ticker.h"
+#include "LagCompensationSubsystem.generated.h"
+
+class ACharacter;
+class APlayerController;
+
+/**
+ * Where a character was at a past server time
+ */
+struct FLagCompensationPose
+{
+	const ACharacter* Character = nullptr;
+	FVector Location = FVector::ZeroVector;
+	FQuat Rotation = FQuat::Identity;
+	float CapsuleRadius = 0.0f;
+	float CapsuleHalfHeight = 0.0f;
+};
+
+/**
+ * Server side history of the registered characters for hit validation against what a client saw.
+ *
+ * Every server tick the transform and capsule of each character is written into a ring of HistoryFrames samples.
+ * The frame times are shared by all characters and the history of one character is contiguous, so a rewind is a
+ * binary search over the frame times and one interpolation per character. Memory is bounded by
+ * MaxCharacters * HistoryFrames samples.
+ */
+UCLASS(Config = Game)
+class MYNETWORKPLUGIN_API ULagCompensationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	// Characters register on the server when they begin play and unregister when they end play
+	void RegisterCharacter(ACharacter* character);
+	void UnregisterCharacter(ACharacter* character);
+
+	// Pose at serverTime interpolated between the samples around it, clamped to the recorded history
+	bool RewindCharacter(const ACharacter* character, double serverTime, FLagCompensationPose& outPose) const;
+	void RewindAllCharacters(double serverTime, TArray<FLagCompensationPose>& outPoses) const;
+
+	// Server time the player saw the other characters at: now minus the one way latency and the interpolation delay
+	// of simulated proxies, never further back than MaxRewindSeconds
+	double GetClientViewTime(const APlayerController* playerController) const;
+
+	// Whether the segment passes through the capsule of target as it was at serverTime
+	bool ConfirmHit(const ACharacter* target, double serverTime, const FVector& traceStart, const FVector& traceEnd, float toleranceCm = 0.0f) const;
+
+	// Measures rewind queries against numCharacters characters once their history is full, see NetBench.LagCompensation
+	void StartRewindBenchmark(int32 numCharacters, int32 numQueries);
+
+	int32 GetNumCharacters() const { return SlotIndices.Num(); }
+	SIZE_T GetHistoryBytes() const { return FrameTimes.GetAllocatedSize() + Samples.GetAllocatedSize() + Slots.GetAllocatedSize(); }
+
+private:
+	struct FSample
+	{
+		FVector Location;
+		FQuat4f Rotation;
+		float CapsuleRadius;
+		float CapsuleHalfHeight;
+	};
+
+	struct FCharacterSlot
+	{
+		TWeakObjectPtr<ACharacter> Character;
+		// First frame recorded for the character, older frames belong to the previous user of the slot
+		uint64 FirstFrame = 0;
+	};
+
+	// Frames around serverTime not older than firstFrame, false when there are none yet
+	bool FindFrames(double serverTime, uint64 firstFrame, uint64& outOlderFrame, uint64& outNewerFrame, float& outAlpha) const;
+	void InterpolatePose(int32 slotIndex, double serverTime, FLagCompensationPose& outPose) const;
+	double GetFrameTime(uint64 frame) const { return FrameTimes[frame % HistoryFrames]; }
+
+	bool TickRewindBenchmark(float deltaTime);
+
+private:
+	// Samples kept per character, 64 frames are about a second of history at 60 Hz
+	UPROPERTY(Config)
+	int32 HistoryFrames = 64;
+
+	UPROPERTY(Config)
+	int32 MaxCharacters = 128;
+
+	// Clients can not claim to have seen the world further back than this
+	UPROPERTY(Config)
+	float MaxRewindSeconds = 0.5f;
+
+	// Delay of simulated proxies behind the latest received state
+	UPROPERTY(Config)
+	float InterpolationDelaySeconds = 0.1f;
+
+	TArray<double> FrameTimes;
+	// HistoryFrames samples per slot, the history of a slot is contiguous
+	TArray<FSample> Samples;
+	TArray<FCharacterSlot> Slots;
+	TArray<int32> FreeSlots;
+	TMap<const ACharacter*, int32> SlotIndices;
+	uint64 NextFrame = 0;
+
+	FTSTicker::FDelegateHandle BenchmarkTickerHandle;
+	uint64 BenchmarkStartFrame = 0;
+	int32 BenchmarkQueries = 0;
+};
@@ -6,6 +6,9 @@
 #include "GameFramework/GameModeBase.h"
 #include "LobbyGameMode.generated.h"
 
+class UJoinAdmissionComponent;
+class UNetBandwidthGovernorComponent;
+
 /**
  * 
  */
@@ -15,6 +18,18 @@ class MYNETWORKPLUGIN_API ALobbyGameMode : public AGameModeBase
 	GENERATED_BODY()
 	
 public:
+	ALobbyGameMode();
+
+	virtual void PreLogin(const FString& Options, const FString& Address, const FUniqueNetIdRepl& UniqueId, FString& ErrorMessage) override;
 	virtual void PostLogin(APlayerController* newplayer) override;
 	virtual void Logout(AController* exiting) override;
+
+protected:
+	/** Splits the host upstream between the connected players */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Network)
+	UNetBandwidthGovernorComponent* BandwidthGovernor;
+
+	/** Capacity, join rate and join queue checks before a joining player is created */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Network)
+	UJoinAdmissionComponent* JoinAdmission;
 };
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "MatchReplaySubsystem.generated.h"
+
+/**
+ * Optional server side recording of the lobby and gameplay maps into compressed local replay files
+ * (Saved/Demos) through the CompressedReplayStreaming module, and playback with scrubbing.
+ *
+ * The demo net driver records at RecordHz within MaxRecordTimeMSPerFrame per frame; the streamer compresses and
+ * writes finished chunks on worker threads so only the chunk being recorded is kept in memory.
+ */
+UCLASS(Config = Game)
+class MYNETWORKPLUGIN_API UMatchReplaySubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	void SetRecordingEnabled(bool bEnabled);
+	bool IsRecordingEnabled() const { return bRecordMatches; }
+
+	void StartRecording(const FString& replayName);
+	void StopRecording();
+	bool IsRecording() const;
+
+	bool PlayReplay(const FString& replayName);
+	// Jumps to the given time of the replay being played, only the closest checkpoint and the chunks after it are read
+	void ScrubReplay(float timeInSeconds);
+
+private:
+	void OnPostLoadMap(UWorld* world);
+	void OnPreLoadMap(const FString& mapName);
+	void ApplyRecordingBudget() const;
+
+private:
+	// Off by default, recording is opt in
+	UPROPERTY(Config)
+	bool bRecordMatches = false;
+
+	// Long package names of the maps recorded on the server
+	UPROPERTY(Config)
+	TArray<FString> RecordedMaps;
+
+	UPROPERTY(Config)
+	float RecordHz = 10.0f;
+
+	// CPU budget of the demo net driver per frame for recording and for saving checkpoints
+	UPROPERTY(Config)
+	float MaxRecordTimeMSPerFrame = 2.0f;
+	UPROPERTY(Config)
+	float MaxCheckpointSaveMSPerFrame = 2.0f;
+
+	// Seconds between checkpoints, the granularity of scrubbing
+	UPROPERTY(Config)
+	float CheckpointIntervalSeconds = 10.0f;
+
+	FDelegateHandle PostLoadMapHandle;
+	FDelegateHandle PreLoadMapHandle;
+};
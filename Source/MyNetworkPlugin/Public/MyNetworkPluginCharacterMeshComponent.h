@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "ComponentTickCost.h"
+#include "MyNetworkPluginCharacterMeshComponent.generated.h"
+
+/**
+ * Mesh of AMyNetworkPluginCharacter, measures what its tick costs
+ */
+UCLASS()
+class MYNETWORKPLUGIN_API UMyNetworkPluginCharacterMeshComponent : public USkeletalMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Animation update and, unless it runs on a worker, pose evaluation
+	const FComponentTickCost& GetTickCost() const { return TickCost; }
+
+private:
+	FComponentTickCost TickCost;
+};
@@ -0,0 +1,148 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "ComponentTickCost.h"
+#include "MyNetworkPluginCharacterMovementComponent.generated.h"
+
+/**
+ * Process wide movement RPC counters, read by the network benchmarks
+ */
+struct FCharacterNetMovementCounters
+{
+	int32 ServerMovesSent = 0;
+	int32 ServerMovesReceived = 0;
+	int32 CorrectionsSent = 0;
+	int32 CorrectionsReceived = 0;
+};
+
+/**
+ * Server corrections of one character, i.e. of the connection owning it. Recorded on the server for remote
+ * characters and on the client for the locally controlled one; plain counters so it can stay on in shipping.
+ */
+struct FMovementCorrectionStats
+{
+	int32 Count = 0;
+	float LastErrorCm = 0.0f;
+	float MaxErrorCm = 0.0f;
+	double TotalErrorCm = 0.0;
+	// World time of the last correction, negative when there was none
+	double LastCorrectionTime = -1.0;
+
+	void AddCorrection(float errorCm, double worldTime);
+	float GetAverageErrorCm() const { return Count > 0 ? static_cast<float>(TotalErrorCm / Count) : 0.0f; }
+};
+
+/**
+ * Interpolation buffer of a simulated proxy. Movement updates are kept with the server time they were sent at and
+ * the mesh is drawn between the two around the playout time, the estimated server time minus the playout delay. The
+ * delay covers an update interval plus the arrival jitter of the updates received over the connection.
+ */
+struct FJitterBufferStats
+{
+	float ArrivalJitterMs = 0.0f;
+	float AverageIntervalMs = 0.0f;
+	float PlayoutDelayMs = 0.0f;
+	// Updates buffered past the playout time and the server time they reach ahead of it
+	int32 Depth = 0;
+	float DepthMs = 0.0f;
+	// Times the playout time passed the latest update of a moving character
+	int32 Underruns = 0;
+};
+
+/**
+ * Movement update of a simulated proxy, stamped with the server time it was sent at
+ */
+struct FProxyMovementSnapshot
+{
+	double ServerTime = 0.0;
+	FVector Location = FVector::ZeroVector;
+	FQuat Rotation = FQuat::Identity;
+	FVector Velocity = FVector::ZeroVector;
+};
+
+/**
+ * Movement component of AMyNetworkPluginCharacter
+ */
+UCLASS(Config = Game)
+class MYNETWORKPLUGIN_API UMyNetworkPluginCharacterMovementComponent : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+
+public:
+	UMyNetworkPluginCharacterMovementComponent();
+
+	static FCharacterNetMovementCounters& GetNetMovementCounters();
+
+	const FMovementCorrectionStats& GetCorrectionStats() const { return CorrectionStats; }
+	// Seconds since the last correction, negative when there was none
+	double GetSecondsSinceLastCorrection() const;
+
+	const FJitterBufferStats& GetJitterBufferStats() const { return JitterBufferStats; }
+
+	const FComponentTickCost& GetTickCost() const { return TickCost; }
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+protected:
+	// Client: a move is sent to the server
+	virtual void CallServerMovePacked(const FSavedMove_Character* NewMove, const FSavedMove_Character* PendingMove, const FSavedMove_Character* OldMove) override;
+	// Server: a move is received from the owning client
+	virtual void ServerMovePacked_ServerReceive(const FCharacterServerMovePackedBits& PackedBits) override;
+	// Server: compares the client location with the simulated one
+	virtual bool ServerCheckClientError(float ClientTimeStamp, float DeltaTime, const FVector& Accel, const FVector& ClientWorldLocation, const FVector& RelativeClientLocation, UPrimitiveComponent* ClientMovementBase, FName ClientBaseBoneName, uint8 ClientMovementMode) override;
+	// Server: the move is acked or corrected
+	virtual void ServerSendMoveResponse(const FClientAdjustment& PendingAdjustment) override;
+	// Client: the ack or correction of the server is received
+	virtual void ClientHandleMoveResponse(const FCharacterMoveResponseDataContainer& MoveResponse) override;
+
+	// Simulated proxy: a movement update is received
+	virtual void SmoothCorrection(const FVector& OldLocation, const FQuat& OldRotation, const FVector& NewLocation, const FQuat& NewRotation) override;
+	// Simulated proxy: the mesh is moved to the buffered movement of the playout time
+	virtual void SmoothClientPosition(float DeltaSeconds) override;
+
+private:
+	bool UsesJitterBuffer() const;
+	void AddMovementSnapshot(const FVector& location, const FQuat& rotation);
+	// False when there is no update to play and the engine smoothing takes over
+	bool PlayMovementSnapshots();
+
+private:
+	FMovementCorrectionStats CorrectionStats;
+
+	// Error of the last checked client move, reported with the next correction
+	float PendingClientErrorCm = 0.0f;
+
+	// Playout delay of simulated proxies: the update interval plus JitterMultiplier times the arrival jitter on top of
+	// BasePlayoutDelay
+	UPROPERTY(Config, EditAnywhere, Category = "Character Movement (Networking)")
+	float BasePlayoutDelay = 0.02f;
+	UPROPERTY(Config, EditAnywhere, Category = "Character Movement (Networking)")
+	float JitterMultiplier = 3.0f;
+	UPROPERTY(Config, EditAnywhere, Category = "Character Movement (Networking)")
+	float MinPlayoutDelay = 0.05f;
+	UPROPERTY(Config, EditAnywhere, Category = "Character Movement (Networking)")
+	float MaxPlayoutDelay = 0.35f;
+
+	// The playout delay grows at once and shrinks by this share of the difference per update
+	UPROPERTY(Config, EditAnywhere, Category = "Character Movement (Networking)")
+	float PlayoutDelayDecay = 0.05f;
+	// Seconds the playout delay grows by on an underrun
+	UPROPERTY(Config, EditAnywhere, Category = "Character Movement (Networking)")
+	float UnderrunBackOff = 0.02f;
+	// Seconds a moving character is extrapolated past its latest update on an underrun before it holds
+	UPROPERTY(Config, EditAnywhere, Category = "Character Movement (Networking)")
+	float MaxExtrapolationTime = 0.1f;
+
+	FJitterBufferStats JitterBufferStats;
+	// Ordered by server time, the first one is the latest at or before the playout time
+	TArray<FProxyMovementSnapshot> MovementSnapshots;
+	float PlayoutDelay = 0.0f;
+	double LastArrivalTime = -1.0;
+	double AverageIntervalSeconds = 0.0;
+	bool bUnderrun = false;
+
+	FComponentTickCost TickCost;
+};
@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "UObject/ObjectKey.h"
+#include "NetBandwidthGovernorComponent.generated.h"
+
+class AController;
+class UNetConnection;
+
+/**
+ * Saturation of one client connection over the last sampling window
+ */
+struct FConnectionSaturationStats
+{
+	TWeakObjectPtr<UNetConnection> Connection;
+	FString PlayerName;
+	int32 CurrentNetSpeed = 0;
+	int32 OutBytesPerSecond = 0;
+	int32 QueuedBits = 0;
+	// Share of the samples in which the connection was not ready to send, 0..1
+	float SaturatedRatio = 0.0f;
+
+	int32 SaturatedSamples = 0;
+	int32 Samples = 0;
+};
+
+/**
+ * Splits the upstream of the host between the connected clients. Lives on the game modes: the per client rate and the
+ * pawn net update frequency follow the player count, and both are backed off while connections or the host saturate.
+ */
+UCLASS(Config = Game, ClassGroup = (Network), meta = (BlueprintSpawnableComponent))
+class MYNETWORKPLUGIN_API UNetBandwidthGovernorComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UNetBandwidthGovernorComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Recomputes the budgets, call when the player count changes. exiting is left out as it is still registered during Logout.
+	void Rebalance(const AController* exiting = nullptr);
+
+	const TArray<FConnectionSaturationStats>& GetConnectionStats() const { return ConnectionStats; }
+	float GetBudgetScale() const { return BudgetScale; }
+	int32 GetClientRate() const { return ClientRate; }
+	float GetPawnNetUpdateFrequency() const { return PawnNetUpdateFrequency; }
+
+protected:
+	virtual void BeginPlay() override;
+
+private:
+	void SampleConnections();
+	void EvaluateWindow();
+
+private:
+	// Upstream of the host shared by all clients, bytes per second
+	UPROPERTY(Config, EditAnywhere, Category = "Bandwidth")
+	int32 HostUpstreamBytesPerSecond = 250000;
+
+	// Per client rate limits, the net driver MaxClientRate and MaxInternetClientRate have to allow MaxClientRate
+	UPROPERTY(Config, EditAnywhere, Category = "Bandwidth")
+	int32 MinClientRate = 8000;
+	UPROPERTY(Config, EditAnywhere, Category = "Bandwidth")
+	int32 MaxClientRate = 100000;
+
+	// Pawns replicate at MaxPawnNetUpdateFrequency up to FullRatePlayerCount players and slow down linearly after that
+	UPROPERTY(Config, EditAnywhere, Category = "Bandwidth")
+	float MaxPawnNetUpdateFrequency = 100.0f;
+	UPROPERTY(Config, EditAnywhere, Category = "Bandwidth")
+	float MinPawnNetUpdateFrequency = 10.0f;
+	UPROPERTY(Config, EditAnywhere, Category = "Bandwidth")
+	int32 FullRatePlayerCount = 8;
+
+	// Connections are sampled every SampleInterval and evaluated every SamplesPerWindow samples
+	UPROPERTY(Config, EditAnywhere, Category = "Saturation")
+	float SampleInterval = 0.1f;
+	UPROPERTY(Config, EditAnywhere, Category = "Saturation")
+	int32 SamplesPerWindow = 10;
+
+	// A window is saturated when this share of the connections was saturated for at least SaturatedRatioThreshold of it
+	UPROPERTY(Config, EditAnywhere, Category = "Saturation")
+	float SaturatedRatioThreshold = 0.25f;
+	UPROPERTY(Config, EditAnywhere, Category = "Saturation")
+	float SaturatedConnectionShare = 0.25f;
+
+	// Multiplicative back off on saturation, additive recovery otherwise
+	UPROPERTY(Config, EditAnywhere, Category = "Saturation")
+	float BackOffFactor = 0.75f;
+	UPROPERTY(Config, EditAnywhere, Category = "Saturation")
+	float RecoveryStep = 0.05f;
+	UPROPERTY(Config, EditAnywhere, Category = "Saturation")
+	float MinBudgetScale = 0.25f;
+
+	TArray<FConnectionSaturationStats> ConnectionStats;
+
+	// Net speed each client connection negotiated, taken the first time it is seen; its rate never goes above it
+	TMap<TObjectKey<UNetConnection>, int32> NegotiatedNetSpeeds;
+
+	int32 WindowSamples = 0;
+
+	float BudgetScale = 1.0f;
+	int32 ClientRate = 0;
+	float PawnNetUpdateFrequency = 0.0f;
+};
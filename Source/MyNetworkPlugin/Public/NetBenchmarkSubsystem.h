@@ -0,0 +1,178 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Containers/Ticker.h"
+#include "Dom/JsonObject.h"
+#include "NetBenchmarkSubsystem.generated.h"
+
+class APawn;
+
+/**
+ * Writes benchmark results to Saved/Benchmarks/<Name>-<Timestamp>.json together with the build they were taken on,
+ * so reports of different builds can be compared
+ */
+struct MYNETWORKPLUGIN_API FNetBenchmarkReport
+{
+	explicit FNetBenchmarkReport(const FString& InName);
+
+	// Adds an entry to the "results" array of the report
+	TSharedRef<FJsonObject> AddResult();
+
+	// Returns the path of the written file, empty on failure
+	FString Save() const;
+
+	FString Name;
+	TSharedRef<FJsonObject> Root;
+	TArray<TSharedPtr<FJsonValue>> Results;
+};
+
+/**
+ * Packet lag, loss and jitter applied to the client net driver during a benchmark run
+ */
+USTRUCT()
+struct FNetEmulationProfile
+{
+	GENERATED_BODY()
+
+	UPROPERTY(Config)
+	FString Name;
+
+	// Outgoing lag and its variance in ms
+	UPROPERTY(Config)
+	int32 PktLag = 0;
+	UPROPERTY(Config)
+	int32 PktLagVariance = 0;
+
+	// Incoming lag range in ms
+	UPROPERTY(Config)
+	int32 PktIncomingLagMin = 0;
+	UPROPERTY(Config)
+	int32 PktIncomingLagMax = 0;
+
+	// Outgoing and incoming loss in percent
+	UPROPERTY(Config)
+	int32 PktLoss = 0;
+	UPROPERTY(Config)
+	int32 PktIncomingLoss = 0;
+
+	// Additional random delay in ms
+	UPROPERTY(Config)
+	int32 PktJitter = 0;
+};
+
+/**
+ * One configuration measured by the server tick benchmark, Begin and End switch the configuration on and off
+ */
+struct FServerTickBenchmarkPhase
+{
+	FString Name;
+	TFunction<void()> Begin;
+	// Optional, called once the warmup passed and the measured part of the phase starts
+	TFunction<void()> BeginMeasure;
+	TFunction<void()> End;
+	// Optional, adds phase specific results next to the tick times
+	TFunction<void(FJsonObject&)> AddResults;
+};
+
+/**
+ * Headless join and move benchmark under network emulation profiles.
+ *
+ * Host:   MyNetworkPlugin /Game/ThirdPerson/Maps/Lobby -server -nosteam
+ * Client: MyNetworkPlugin -game -nullrhi -nosteam -NetBenchExit -ExecCmds="NetBench.Join 127.0.0.1 20"
+ *
+ * For every profile the client joins the host, moves its pawn for the given time and records join time,
+ * move RPC rate, server corrections and bandwidth into Saved/Benchmarks/NetEmulation-*.json.
+ *
+ * Server side benchmarks spawn characters that run in circles on the host and compare the server tick time,
+ * from the start of the world tick until all net drivers are flushed, between phases.
+ */
+UCLASS(Config = Game)
+class MYNETWORKPLUGIN_API UNetBenchmarkSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	// Runs the join benchmark against address for the given profiles, all configured profiles if empty
+	void StartJoinBenchmark(const FString& address, float secondsPerProfile, const TArray<FString>& profileNames);
+	bool IsRunning() const { return Phase != EBenchmarkPhase::Idle; }
+
+	// Measures the server tick with numCharacters moving characters once per phase, needs a server world
+	void StartServerTickBenchmark(const FString& reportName, int32 numCharacters, float secondsPerPhase, TArray<FServerTickBenchmarkPhase> phases);
+
+	// Spawns default pawns possessed by AI controllers, they run in circles while a benchmark is running
+	void SpawnBenchmarkCharacters(int32 numCharacters);
+	void DestroyBenchmarkCharacters();
+	int32 GetNumBenchmarkCharacters() const { return BenchmarkCharacters.Num(); }
+
+	const FNetEmulationProfile* FindEmulationProfile(const FString& profileName) const;
+	static void ApplyEmulationProfile(const FNetEmulationProfile& profile);
+
+private:
+	enum class EBenchmarkPhase : uint8
+	{
+		Idle,
+		Joining,
+		Moving,
+		ServerTick
+	};
+
+	bool Tick(float deltaTime);
+	void StartNextProfile();
+	void FinishProfile(bool bJoined);
+	void FinishBenchmark();
+
+	void MoveBenchmarkCharacters(double time);
+	void StartNextServerTickPhase();
+	void FinishServerTickPhase();
+	void OnServerTickDispatch(float deltaTime);
+	void OnServerPostTickFlush();
+
+private:
+	UPROPERTY(Config)
+	TArray<FNetEmulationProfile> EmulationProfiles;
+
+	// Give up on a profile when the pawn is not possessed after this many seconds
+	UPROPERTY(Config)
+	float JoinTimeoutSeconds = 60.0f;
+
+	// Samples taken after a phase started are dropped for this long so spawns and travels settle
+	UPROPERTY(Config)
+	float WarmupSeconds = 2.0f;
+
+	EBenchmarkPhase Phase = EBenchmarkPhase::Idle;
+	FTSTicker::FDelegateHandle TickerHandle;
+
+	TArray<FNetEmulationProfile> PendingProfiles;
+	FNetEmulationProfile CurrentProfile;
+	FString Address;
+	float SecondsPerProfile = 20.0f;
+
+	// The join is done once a pawn is possessed in a world other than the one the travel started from
+	TWeakObjectPtr<UWorld> TravelStartWorld;
+	double JoinStartTime = 0.0;
+	double MoveStartTime = 0.0;
+	double JoinSeconds = 0.0;
+	int32 StartServerMovesSent = 0;
+	int32 StartCorrectionsReceived = 0;
+	uint32 StartInBytes = 0;
+	uint32 StartOutBytes = 0;
+
+	TArray<TWeakObjectPtr<APawn>> BenchmarkCharacters;
+	TArray<FServerTickBenchmarkPhase> PendingServerTickPhases;
+	FServerTickBenchmarkPhase CurrentServerTickPhase;
+	TWeakObjectPtr<UWorld> ServerWorld;
+	FDelegateHandle TickDispatchHandle;
+	FDelegateHandle PostTickFlushHandle;
+	float SecondsPerPhase = 10.0f;
+	double PhaseStartTime = 0.0;
+	bool bPhaseWarmedUp = false;
+	double TickStartTime = 0.0;
+	TArray<double> ServerTickSamplesMs;
+
+	TUniquePtr<FNetBenchmarkReport> Report;
+};
@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "PacketCompressionBenchmarkCommandlet.generated.h"
+
+/**
+ * Replays the packet streams captured by the Oodle network handler (bCaptureMode) through the Oodle codec and
+ * reports the compression ratio and the encode and decode time per packet, the cost on the sending and on the
+ * receiving end.
+ *
+ * UnrealEditor-Cmd MyNetworkPlugin.uproject -run=PacketCompressionBenchmark [-Captures=<Dir>] [-Train [-TrainShare=0.75]]
+ *
+ * Server and client captures are measured separately with the ServerDictionary and ClientDictionary configured in
+ * [OodleNetworkHandlerComponent], i.e. what the game ships with. With -Train each stream is instead trained on the
+ * first TrainShare of its packets and measured on the rest. Results go to Saved/Benchmarks/PacketCompression-*.json.
+ */
+UCLASS()
+class MYNETWORKPLUGIN_API UPacketCompressionBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UPacketCompressionBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/NetSerialization.h"
+#include "QuantizedCharacterMovement.generated.h"
+
+/**
+ * Step sizes of the replicated movement fields, read from the character config so server and clients agree
+ */
+struct FMovementQuantization
+{
+	float LocationCm = 1.0f;
+	float VelocityCmPerSecond = 2.0f;
+	int32 YawBits = 12;
+	int32 PitchRollBits = 8;
+};
+
+/**
+ * Location, velocity and rotation of a character in quantization steps
+ */
+struct FQuantizedMovementState
+{
+	// Location xyz, velocity xyz, pitch yaw roll
+	static constexpr int32 NumComponents = 9;
+	static constexpr int32 FirstRotationComponent = 6;
+
+	int32 Components[NumComponents] = {};
+
+	static FQuantizedMovementState Quantize(const FMovementQuantization& quantization, const FVector& location, const FRotator& rotation, const FVector& velocity);
+	void Dequantize(const FMovementQuantization& quantization, FVector& outLocation, FRotator& outRotation, FVector& outVelocity) const;
+
+	bool operator==(const FQuantizedMovementState& other) const;
+};
+
+/**
+ * Replicated movement of simulated proxies in place of ReplicatedMovement.
+ *
+ * Every update is a delta against the last state the connection is known to have, with one bit per component so
+ * unchanged components cost nothing and changed ones only the bits of their delta. Lost updates roll the base back
+ * through the engine's custom delta state handling; clients keep the recent states by id to decode against, and the
+ * server falls back to a full state once its base is older than MaxBaseAgeSeconds.
+ */
+USTRUCT()
+struct MYNETWORKPLUGIN_API FQuantizedCharacterMovement
+{
+	GENERATED_BODY()
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+
+	// Whether characters replicate their movement in this format, net.QuantizedCharacterMovement
+	static bool IsEnabled();
+
+	FMovementQuantization Quantization;
+	float MaxBaseAgeSeconds = 0.5f;
+
+	// Server: the state sent with the next update
+	FQuantizedMovementState Current;
+
+	// Client: the latest decoded state, bReceived until it is applied
+	FQuantizedMovementState Received;
+	bool bReceived = false;
+
+private:
+	struct FReceivedState
+	{
+		uint32 Id = 0;
+		FQuantizedMovementState State;
+	};
+
+	static constexpr int32 NumReceivedStates = 64;
+
+	uint32 NextStateId = 1;
+	TArray<FReceivedState> ReceivedStates;
+};
+
+template<>
+struct TStructOpsTypeTraits<FQuantizedCharacterMovement> : public TStructOpsTypeTraitsBase2<FQuantizedCharacterMovement>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
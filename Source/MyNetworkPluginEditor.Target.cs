@@ -10,6 +10,6 @@ public class MyNetworkPluginEditorTarget : TargetRules
 		Type = TargetType.Editor;
 		DefaultBuildSettings = BuildSettingsVersion.V5;
 		IncludeOrderVersion = EngineIncludeOrderVersion.Unreal5_4;
-		ExtraModuleNames.Add("MyNetworkPlugin");
+		ExtraModuleNames.AddRange(new string[] { "MyNetworkPlugin", "CompressedReplayStreaming" });
 	}
 }